@@ -2,12 +2,6 @@ ASSEMBLER=../asembler
 LINKER=../linker
 EMULATOR=../emulator
 
-${ASSEMBLER} -o main.o main.s
-${ASSEMBLER} -o math.o math.s
-${ASSEMBLER} -o ivt.o ivt.s
-${ASSEMBLER} -o isr_reset.o isr_reset.s
-${ASSEMBLER} -o isr_terminal.o isr_terminal.s
-${ASSEMBLER} -o isr_timer.o isr_timer.s
-${ASSEMBLER} -o isr_user0.o isr_user0.s
+${ASSEMBLER} -j 4 main.s math.s ivt.s isr_reset.s isr_terminal.s isr_timer.s isr_user0.s
 ${LINKER} -hex -o program.hex ivt.o math.o main.o isr_reset.o isr_terminal.o isr_timer.o isr_user0.o
 ${EMULATOR} program.hex
\ No newline at end of file
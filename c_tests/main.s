@@ -0,0 +1,12 @@
+# file: main.s
+
+.global my_start
+
+.section my_code
+my_start:
+  ldr r6, $0x0300 # the stack starts right above the code
+loop:
+  push r0 # under -engine=jit the overflow is hit by the push that starts a translated block
+  jmp loop
+
+.end
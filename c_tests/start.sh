@@ -0,0 +1,7 @@
+ASSEMBLER=../asembler
+LINKER=../linker
+EMULATOR=../emulator
+
+${ASSEMBLER} -j 4 main.s ivt.s
+${LINKER} -hex -place=ivt@0x0000 -place=my_code@0x0100 -o program.hex ivt.o main.o
+${EMULATOR} -engine=jit program.hex
\ No newline at end of file
@@ -0,0 +1,13 @@
+# file: isr.s
+
+.extern my_start
+
+.section isr
+.global isr_reset, isr_timer, isr_terminal
+isr_reset:
+  jmp my_start
+isr_timer:
+isr_terminal:
+  iret
+
+.end
@@ -0,0 +1,17 @@
+# file: main.s
+
+.global my_start
+
+.section my_code
+my_start:
+  ldr r6, $0xFEFE # init SP
+  ldr r0, $0x6F # 'o'
+  str r0, 0xFF00 # term_out
+  ldr r0, $0x6B # 'k'
+  str r0, 0xFF00
+  ldr r0, $0x0A # '\n'
+  str r0, 0xFF00
+wait: # never halts, the output has to reach the file while it runs
+  jmp wait
+
+.end
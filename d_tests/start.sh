@@ -0,0 +1,12 @@
+ASSEMBLER=../asembler
+LINKER=../linker
+EMULATOR=../emulator
+
+${ASSEMBLER} -j 4 main.s isr.s ivt.s
+${LINKER} -hex -place=ivt@0x0000 -o program.hex ivt.o main.o isr.o
+# headless output is flushed every 10000 virtual microseconds, so "ok" is in the file long before the time limit stops the run
+rm -f output.txt
+${EMULATOR} -headless -output=output.txt -time-limit=3000 program.hex &
+sleep 1
+cat output.txt
+wait
@@ -0,0 +1,76 @@
+#ifndef _ARCHIVE_H_
+#define _ARCHIVE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Image.hpp"
+
+/* Static library written by the archiver and mapped by the linker, all fields little endian.
+ *
+ *  header   32 bytes, ArchiveHeader
+ *  members  memberCount entries of 12 bytes, ArchiveMember
+ *  symbols  symbolCount entries of 8 bytes, ArchiveSymbol, sorted by name, the globals the members define
+ *  strings  zero terminated member and symbol names
+ *  objects  the members as binary objects, each at a multiple of 4
+ */
+
+#define ARCHIVE_MAGIC "SSAR"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 32
+#define ARCHIVE_MEMBER_SIZE 12
+#define ARCHIVE_SYMBOL_SIZE 8
+
+struct ArchiveHeader{
+  char magic[4];
+  uint16_t version;
+  uint16_t flags;
+  uint32_t memberCount;
+  uint32_t symbolCount;
+  uint32_t memberTable; // file offsets of the tables
+  uint32_t symbolTable;
+  uint32_t stringTable;
+  uint32_t stringSize;
+};
+
+struct ArchiveMember{
+  uint32_t name;   // offset in the string table
+  uint32_t offset; // file offset of the object
+  uint32_t size;
+};
+
+struct ArchiveSymbol{
+  uint32_t name;
+  uint32_t member; // index of the member that defines the symbol
+};
+
+class ObjectFile;
+
+// members in the given order under the given names, the index holds every global a member defines,
+// a name defined by more than one member keeps the first
+std::vector<unsigned char> writeArchive(const std::vector<std::string>& names, const std::vector<const ObjectFile*>& members);
+
+// read only mapping of an archive, members are only looked at when the linker asks for them
+class ArchiveFile{
+  void* mapping;
+  size_t size;
+  const unsigned char* data;
+  ArchiveHeader header;
+public:
+  ArchiveFile(const std::string& name);
+  ~ArchiveFile();
+  ArchiveFile(const ArchiveFile&) = delete;
+  ArchiveFile& operator=(const ArchiveFile&) = delete;
+
+  uint32_t memberCount() const {return header.memberCount;}
+  ArchiveMember member(uint32_t index) const;
+  ArchiveSymbol symbol(uint32_t index) const;
+  std::string_view string(uint32_t offset) const {return std::string_view((const char*)data + header.stringTable + offset);}
+  const unsigned char* contents(const ArchiveMember& member) const {return data + member.offset;}
+
+  // member that defines the global symbol, -1 if no member does
+  int findSymbol(std::string_view name) const;
+};
+
+#endif
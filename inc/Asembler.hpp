@@ -1,13 +1,14 @@
 #ifndef _ASEMBLER_
 #define _ASEMBLER_
 
-#include <regex>
 #include <vector>
 #include <string>
 #include <iostream>
 #include "Exceptions.hpp"
 #include "SymbolTable.hpp"
 #include "RelTable.hpp"
+#include "Lexer.hpp"
+#include "ObjectFile.hpp"
 
 using namespace std;
 
@@ -59,31 +60,33 @@ class Asembler{
   private:
     string input;
     string output;
-    static int lineCnt;
+    bool textOutput; // the old line based object format instead of the binary one
+    int lineCnt = 1;
     vector<vector<unsigned char>> generatedCode;  //
     vector<string> sections;                      // --> generated code is split between sections
-    static int sectionIndexForGeneratedCode;      //
+    int sectionIndexForGeneratedCode = 0;         //
     SymbolTable symbolTable;
     RelocationTable relocationTable;
 
-    static int lc;
+    int lc = 0;
   public:
-    Asembler(string i, string o = "asemblerOutput.o") : input(i), output(o) {}
+    Asembler(string i, string o = "asemblerOutput.o", bool text = false) : input(i), output(o), textOutput(text) {}
     ~Asembler() {}
 
 
     void assemble();
 
-    int processLine(string line);
-    int processDirective(string line);
-    int processInstruction(string line);
-    int processInstructionWithLabel(string line);
+    int processLine(Lexer& lexer);
+    int processDirective(Lexer& lexer);
+    int processInstruction(string_view mnemonic, Lexer& lexer);
+    int processInstructionWithLabel(string_view label, Lexer& lexer);
     int processLabelOnly(string label);
 
     int backpatchAndGenerateRealocationEntries();
     void formOutput(ofstream& output);
+    void formBinaryOutput(ofstream& output);
 
-    friend int switchInstruction(Instructions instr, string line, Asembler* as);
+    friend int switchInstruction(Instructions instr, Lexer& lexer, Asembler* as);
     friend void switchDataOperand(Operand op, Asembler* asem, unsigned char opCode, unsigned char regDest);
     friend void switchAddressOperand(Operand op, Asembler* asem, unsigned char opCode);
     friend int getSectionIndexOfASymbol(Asembler* as, int secNum);
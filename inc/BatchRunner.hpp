@@ -0,0 +1,41 @@
+#ifndef _BATCH_RUNNER_H_
+#define _BATCH_RUNNER_H_
+
+#include <deque>
+#include <mutex>
+#include "Emulator.hpp"
+
+// one line of the manifest, run headless in its own Emulator
+struct BatchJob{
+  EmulatorOptions options;
+  string status; // halt, fault or limit
+  string message; // reason of a fault or a limit
+  string state; // final processor state as printed by writeOutput, whatever stopped a loaded image
+  string output; // bytes written to term_out
+  unsigned long long instructions;
+  BatchJob() {instructions = 0;}
+};
+
+// jobs of one worker, the owner takes from the back and the others steal from the front
+struct WorkQueue{
+  mutex lock;
+  deque<size_t> jobs;
+};
+
+class BatchRunner{
+private:
+  vector<BatchJob> jobs;
+  int workers;
+
+  void worker(vector<WorkQueue>& queues, int id);
+  bool take(vector<WorkQueue>& queues, int id, size_t& job);
+  void runJob(BatchJob& job);
+public:
+  BatchRunner(const string& manifest, const EmulatorOptions& defaults, int threads = 0);
+
+  void run();
+  void writeReport(ostream& out) const;
+  int status() const; // exit status of the batch: 1 if a job faulted, else 2 if one hit a limit, else 0
+};
+
+#endif
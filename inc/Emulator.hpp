@@ -5,14 +5,26 @@
 #define term_in 0xFF02
 #define tim_cfg 0xFF10
 
+#define INSTRUCTIONS_PER_MILLISECOND 1000 // virtual time of the timer
+#define WATCHDOG_INTERVAL 1000000 // instructions between two looks at the wall clock
+
 #include <vector>
 #include <map>
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <chrono>
 #include <termios.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "Exceptions.hpp"
+#include "Jit.hpp"
+#include "Image.hpp"
+#include "Terminal.hpp"
+#include "Scheduler.hpp"
+#include "InterruptController.hpp"
 
 using namespace std;
 
@@ -33,6 +45,50 @@ enum AddressModes{
   REGISTER_DIRECT_ADDITION
 };
 
+enum class Engines{
+  REFERENCE, // one indirect call per instruction through the decoded handler
+  THREADED,  // computed goto, one handler per (opcode, address mode) pair
+  JIT        // hot basic blocks translated to x86-64, the rest interpreted
+};
+
+#ifdef EMULATOR_THREADED
+#define DEFAULT_ENGINE Engines::THREADED
+#else
+#define DEFAULT_ENGINE Engines::REFERENCE
+#endif
+
+// handlers of the threaded engine, jump and data handlers follow the order of AddressModes
+enum ThreadedHandlers{
+  H_HALT, H_INT, H_IRET, H_RET,
+  H_XCHG, H_ADD, H_SUB, H_MUL, H_DIV, H_CMP,
+  H_NOT, H_AND, H_OR, H_XOR, H_TEST, H_SHL, H_SHR,
+  H_CALL_IMMEDIATE, H_CALL_REGISTER_DIRECT, H_CALL_REGISTER_INDIRECT, H_CALL_REGISTER_INDIRECT_OFFSET, H_CALL_MEMORY, H_CALL_REGISTER_DIRECT_ADDITION,
+  H_JMP_IMMEDIATE, H_JMP_REGISTER_DIRECT, H_JMP_REGISTER_INDIRECT, H_JMP_REGISTER_INDIRECT_OFFSET, H_JMP_MEMORY, H_JMP_REGISTER_DIRECT_ADDITION,
+  H_JEQ_IMMEDIATE, H_JEQ_REGISTER_DIRECT, H_JEQ_REGISTER_INDIRECT, H_JEQ_REGISTER_INDIRECT_OFFSET, H_JEQ_MEMORY, H_JEQ_REGISTER_DIRECT_ADDITION,
+  H_JNE_IMMEDIATE, H_JNE_REGISTER_DIRECT, H_JNE_REGISTER_INDIRECT, H_JNE_REGISTER_INDIRECT_OFFSET, H_JNE_MEMORY, H_JNE_REGISTER_DIRECT_ADDITION,
+  H_JGT_IMMEDIATE, H_JGT_REGISTER_DIRECT, H_JGT_REGISTER_INDIRECT, H_JGT_REGISTER_INDIRECT_OFFSET, H_JGT_MEMORY, H_JGT_REGISTER_DIRECT_ADDITION,
+  H_LDR_IMMEDIATE, H_LDR_REGISTER_DIRECT, H_LDR_REGISTER_INDIRECT, H_LDR_REGISTER_INDIRECT_OFFSET, H_LDR_MEMORY, H_LDR_REGISTER_DIRECT_ADDITION,
+  H_STR_IMMEDIATE, H_STR_REGISTER_DIRECT, H_STR_REGISTER_INDIRECT, H_STR_REGISTER_INDIRECT_OFFSET, H_STR_MEMORY, H_STR_REGISTER_DIRECT_ADDITION,
+  H_PUSH, H_POP,
+  H_REFERENCE // anything else is executed by the reference handler
+};
+
+// last flag producing operation whose psw bits were not computed yet
+enum LazyFlags{
+  FLAGS_MATERIALIZED, // psw holds every flag
+  FLAGS_CMP,  // Z, O, C and N
+  FLAGS_TEST, // Z and N
+  FLAGS_SHL,  // Z, C and N
+  FLAGS_SHR   // Z, C and N
+};
+
+// terminal character fed to the guest at a given instruction count in headless mode
+struct ScriptedInput{
+  unsigned long long at;
+  unsigned char character;
+  ScriptedInput(unsigned long long a, unsigned char c) {at = a; character = c;}
+};
+
 struct RegisterDescription{
   short destination;
   short source;
@@ -40,58 +96,164 @@ struct RegisterDescription{
   RegisterDescription(unsigned char regDescr) {destination = (regDescr & 0xF0) >> 4; source = regDescr & 0xF;}
 };
 
+// bits of the per page attribute table, writes to pages without any go straight to memory
+enum PageAttributes{
+  PAGE_DECODED = 1, // holds at least one decoded instruction
+  PAGE_DEVICE = 2   // holds memory mapped registers
+};
+
+class Emulator;
+
+// handler of writes to a device's registers, gets the address of the written word
+typedef void (Emulator::*DeviceHandler)(int address);
+
+struct Device{
+  int first; // first and last address of the device's registers
+  int last;
+  DeviceHandler write;
+  Device(int f, int l, DeviceHandler w) {first = f; last = l; write = w;}
+};
+
+// instruction as it was decoded on its first execution, cached by its address
+struct DecodedInstruction{
+  void (Emulator::*handler)(const DecodedInstruction&);
+  void (Emulator::*pswHandler)(const DecodedInstruction&); // real handler of instructions naming psw as a register
+  int* destination;
+  int* source;
+  int operand; // immediate value, offset, address or addition, depending on the address mode
+  unsigned char opCode;
+  unsigned char regDest;
+  unsigned char regSrc;
+  unsigned char addrMode;
+  unsigned char update;
+  unsigned char length;
+  unsigned char threadedHandler;
+  bool valid;
+  DecodedInstruction() {handler = pswHandler = nullptr; destination = source = nullptr; operand = 0; opCode = regDest = regSrc = addrMode = update = 0; length = 1; threadedHandler = H_REFERENCE; valid = false;}
+};
+
+// configuration of one run, given on the command line or on a line of a batch manifest
+struct EmulatorOptions{
+  string input; // hex image
+  Engines engine = DEFAULT_ENGINE;
+  Terminal::FlushPolicy flushPolicy = Terminal::FLUSH_EVERY_INTERVAL;
+  int flushInterval = 10000; // microseconds, virtual ones when headless
+  bool headless = false;
+  bool statistics = false;
+  string inputText; // scripted terminal input
+  string inputSchedule; // file with "<instruction count> <characters>" lines
+  int inputInterval = 10000;
+  string output; // file for the terminal output
+  unsigned long long instructionLimit = 0;
+  int timeLimit = 0;
+
+  bool parse(const string& argument); // false if the argument is not an option
+};
+
 class Emulator{
 private:
+  friend class JitCompiler;
+
   int r[8] = {0}; // r[7] = pc, r[6] = sp
   int psw;
-  unsigned char memory[65536] = {0};
-  unsigned char interruptRequests; // zeroth bit reset, first error, second timer and third terminal interrupts
+  int flagOperation; // one of LazyFlags
+  int flagResult; // Z and N of the pending operation come from this
+  int flagDestination; // C and O of the pending operation come from these
+  int flagSource;
+  int unusedRegister; // target of register fields that name no register
+  // one extra byte for word accesses at 0xFFFF, three more for the operands decode fetches before pc is checked
+  unsigned char memory[65536 + 4] = {0};
+  InterruptController interrupts;
+
+  DecodedInstruction decodeCache[65536];
+  unsigned char pageAttributes[256 + 1] = {0}; // PageAttributes of every page
+  vector<Device> devices;
 
   string input;
+  Engines engine;
+  JitCompiler* jit;
   int maxAddress; // top address of code
   bool terminalBreak; // indicates if there was any output from terminal
+  Terminal terminal;
+
+  EventScheduler scheduler;
+  unsigned long long instructionCount; // virtual time
+  unsigned long long nextEvent; // due time of the earliest scheduled event
+
+  vector<ScriptedInput> script; // sorted by instruction count
+  size_t scriptPosition;
+  unsigned long long instructionLimit; // 0 for no limit
+  int timeLimit; // milliseconds, 0 for no limit
+  chrono::steady_clock::time_point startTime;
+  FILE* outputFile;
 
-  void instructionINT();
-  void instructionIRET();
-  void instructionCALL();
-  void instructionRET();
-  void instructionJMP();
-  void instructionJEQ();
-  void instructionJNE();
-  void instructionJGT();
-  void instructionXCHG();
-  void instructionADD();
-  void instructionSUB();
-  void instructionMUL();
-  void instructionDIV();
-  void instructionCMP();
-  void instructionNOT();
-  void instructionAND();
-  void instructionOR();
-  void instructionXOR();
-  void instructionTEST();
-  void instructionSHL();
-  void instructionSHR();
-  void instructionLDR();
-  void instructionSTR();
-
-  void checkForInterrupts();
+  void instructionINT(const DecodedInstruction& instr);
+  void instructionIRET(const DecodedInstruction& instr);
+  void instructionCALL(const DecodedInstruction& instr);
+  void instructionRET(const DecodedInstruction& instr);
+  void instructionJMP(const DecodedInstruction& instr);
+  void instructionJEQ(const DecodedInstruction& instr);
+  void instructionJNE(const DecodedInstruction& instr);
+  void instructionJGT(const DecodedInstruction& instr);
+  void instructionXCHG(const DecodedInstruction& instr);
+  void instructionADD(const DecodedInstruction& instr);
+  void instructionSUB(const DecodedInstruction& instr);
+  void instructionMUL(const DecodedInstruction& instr);
+  void instructionDIV(const DecodedInstruction& instr);
+  void instructionCMP(const DecodedInstruction& instr);
+  void instructionNOT(const DecodedInstruction& instr);
+  void instructionAND(const DecodedInstruction& instr);
+  void instructionOR(const DecodedInstruction& instr);
+  void instructionXOR(const DecodedInstruction& instr);
+  void instructionTEST(const DecodedInstruction& instr);
+  void instructionSHL(const DecodedInstruction& instr);
+  void instructionSHR(const DecodedInstruction& instr);
+  void instructionLDR(const DecodedInstruction& instr);
+  void instructionSTR(const DecodedInstruction& instr);
+  void instructionIllegal(const DecodedInstruction& instr);
+  void instructionAccessingPSW(const DecodedInstruction& instr);
+
+  int* registerAddress(short number);
+  DecodedInstruction& decode(int address);
+  unsigned char threadedHandlerIndex(const DecodedInstruction& instr);
+  void invalidateDecoded(int address);
+
+  void executeReference();
+  void executeThreaded();
+  void executeJit();
+  void afterInstruction(int executed = 1);
+  void enterInterrupt();
+  void runEvents();
+  void registerDevice(int first, int last, DeviceHandler write);
+  void deviceWrite(int address);
+  void terminalWrite(int address);
+  void timerWrite(int address);
+  void scheduleTimer(unsigned long long from);
+  void scheduleInput();
+  void scheduleFlush();
+  void deliverInput();
 
   void setZ();
   void resetZ();
-  bool getZ() const {return (psw & 1) != 0;}
+  bool getZ() const {return flagOperation == FLAGS_MATERIALIZED ? (psw & 1) != 0 : flagResult == 0;}
 
   void setO();
   void resetO();
-  bool getO() const {return (psw & 2) != 0;}
+  bool getO() const {return flagOperation == FLAGS_CMP ? lazyO() : (psw & 2) != 0;}
 
   void setC();
   void resetC();
-  bool getC() const {return (psw & 4) != 0;}
+  bool getC() const {return flagOperation >= FLAGS_SHL || flagOperation == FLAGS_CMP ? lazyC() : (psw & 4) != 0;}
 
   void setN();
   void resetN();
-  bool getN() const {return (psw & 8) != 0;}
+  bool getN() const {return flagOperation == FLAGS_MATERIALIZED ? (psw & 8) != 0 : (flagResult & 0x8000) != 0;}
+
+  bool lazyO() const;
+  bool lazyC() const;
+  void setFlags(int operation, int result, int destination, int source);
+  void materializeFlags() {if (flagOperation != FLAGS_MATERIALIZED) computeFlags();}
+  void computeFlags();
 
   void setTr();
   void resetTr();
@@ -105,7 +267,6 @@ private:
   void resetI();
   bool getI() const {return (psw & 32768) != 0;}
 
-  void incPC();
   void push(int& destinationRegister);
   void pop(int& destinationRegister);
   string PSWbits();
@@ -117,11 +278,17 @@ private:
   void setMemoryValue(int address, int value);
 public:
   void loadMemory();
+  bool loadImage();
   void execute();
-  void writeOutput();
+  void writeOutput(ostream& out = cout, bool halted = true); // halted is false for a fault or a limit
+  void writeStatistics(ostream& out = cout);
+  void configure(const EmulatorOptions& options);
+  void scriptInput(unsigned long long at, const string& text, int interval);
+  void captureOutput(string* output) {terminal.captureOutput(output);}
+  unsigned long long executedInstructions() const {return instructionCount;}
 
-  Emulator(string i);
-  ~Emulator() {}
+  Emulator(string i, Engines e = DEFAULT_ENGINE);
+  ~Emulator();
 };
 
 #endif
\ No newline at end of file
@@ -248,6 +248,41 @@ public:
   }
 };
 
+class InvalidImageError : public std::exception {
+public:
+	virtual const char* what() const throw() {
+    return "Image error: the binary image is damaged or has an unknown version.";
+  }
+};
+
+class InvalidObjectError : public std::exception {
+public:
+	virtual const char* what() const throw() {
+    return "Object error: the object file is damaged or has an unknown version.";
+  }
+};
+
+class InvalidArchiveError : public std::exception {
+public:
+	virtual const char* what() const throw() {
+    return "Archive error: the archive is damaged or has an unknown version.";
+  }
+};
+
+class IncrementalLinkError : public std::exception {
+public:
+	virtual const char* what() const throw() {
+    return "Link error: the incremental link differs from a clean one, the next link starts over.";
+  }
+};
+
+class InvalidHexError : public std::exception {
+public:
+	virtual const char* what() const throw() {
+    return "Hex error: the input contains a malformed hex line.";
+  }
+};
+
 class PCOutOfBoundsError : public std::exception {
 public:
 	virtual const char* what() const throw() {
@@ -269,6 +304,23 @@ public:
   }
 };
 
+// emulation was stopped by one of its limits and not by the emulated program
+class EmulationLimitReached : public std::exception {};
+
+class InstructionLimitReached : public EmulationLimitReached {
+public:
+	virtual const char* what() const throw() {
+    return "Emulation stopped because the instruction limit was reached.";
+  }
+};
+
+class TimeLimitReached : public EmulationLimitReached {
+public:
+	virtual const char* what() const throw() {
+    return "Emulation stopped because the time limit was reached.";
+  }
+};
+
 class IllegalInstructionError : public std::exception {
 private:
   const char* symbol;
@@ -0,0 +1,22 @@
+#ifndef _HEX_CODEC_H_
+#define _HEX_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* Text hex shared by the assembler, the linker and the emulator: bytes are written as two
+ * upper case digits, each followed by a separator (':' in object files, ' ' in hex dumps).
+ * Whole blocks of 16 or 32 bytes go through SSSE3 or AVX2 when the processor has them. */
+
+// decodes at most maxCount tokens, a separator after the last token is optional,
+// returns the number of decoded bytes or -1 if the text is not separated hex
+long decodeHex(const char* text, size_t length, char separator, unsigned char* out, size_t maxCount = SIZE_MAX);
+
+// writes 3 * count characters, every byte followed by the separator
+void encodeHex(const unsigned char* bytes, size_t count, char separator, char* out);
+
+// value as digits upper case hex digits with leading zeros
+void appendHex(std::string& out, unsigned value, int digits);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <cstdint>
+
+/* Binary image written by "linker -bin" and mapped by the emulator, all fields little endian.
+ *
+ *  header        32 bytes, ImageHeader
+ *  segments      segmentCount entries of 12 bytes, ImageSegment
+ *  symbols       symbolCount entries of 8 bytes, ImageSymbol
+ *  lines         lineCount entries of 12 bytes, ImageLine
+ *  strings       zero terminated names, symbols and lines point into them
+ *  segment data  bytes of every segment, at the offsets in the segment table
+ */
+
+#define IMAGE_MAGIC "SSIM"
+#define IMAGE_VERSION 1
+#define IMAGE_HEADER_SIZE 32
+#define IMAGE_SEGMENT_SIZE 12
+#define IMAGE_SYMBOL_SIZE 8
+#define IMAGE_LINE_SIZE 12
+
+struct ImageHeader{
+  char magic[4];
+  uint16_t version;
+  uint16_t entry; // initial pc, the reset entry of the vector table
+  uint16_t segmentCount;
+  uint16_t symbolCount;
+  uint16_t lineCount;
+  uint16_t flags;
+  uint32_t segmentTable; // file offsets of the tables
+  uint32_t symbolTable;
+  uint32_t lineTable;
+  uint32_t stringTable;
+};
+
+struct ImageSegment{
+  uint32_t address;
+  uint32_t size;
+  uint32_t offset; // file offset of the segment's bytes
+};
+
+struct ImageSymbol{
+  uint32_t value;
+  uint32_t name; // offset in the string table
+};
+
+struct ImageLine{
+  uint32_t address;
+  uint32_t line;
+  uint32_t file; // offset in the string table
+};
+
+inline uint16_t readImage16(const unsigned char* p) {return p[0] | (p[1] << 8);}
+inline uint32_t readImage32(const unsigned char* p) {return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);}
+
+inline void writeImage16(unsigned char* p, uint16_t value) {p[0] = value & 0xFF; p[1] = value >> 8;}
+inline void writeImage32(unsigned char* p, uint32_t value) {for (int i = 0; i < 4; i++) p[i] = (value >> (i * 8)) & 0xFF;}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _INTERRUPT_CONTROLLER_H_
+#define _INTERRUPT_CONTROLLER_H_
+
+#include <ostream>
+
+// interrupt request lines, the number is the entry in the vector table
+enum InterruptLines{
+  INTERRUPT_RESET,
+  INTERRUPT_ERROR,
+  INTERRUPT_TIMER,
+  INTERRUPT_TERMINAL,
+  INTERRUPT_LINES = 8
+};
+
+// pending requests and the psw mask are combined into one word whenever either changes,
+// so the cpu loop only tests that word after an instruction
+class InterruptController{
+private:
+  unsigned char requests;
+  unsigned char enabled; // lines psw lets through
+  unsigned char deliverable; // requests & enabled
+
+  unsigned long long requestedAt[INTERRUPT_LINES]; // instruction count of the oldest pending request
+  unsigned long long requested[INTERRUPT_LINES];
+  unsigned long long delivered[INTERRUPT_LINES];
+  unsigned long long totalLatency[INTERRUPT_LINES];
+  unsigned long long maxLatency[INTERRUPT_LINES];
+public:
+  InterruptController();
+
+  void request(int line, unsigned long long now);
+  void setMask(int psw); // called whenever I, Tr or Tl may have changed
+  bool pending() const {return deliverable != 0;}
+  int acknowledge(unsigned long long now); // clears and returns the line to enter, the lowest pending one
+
+  void writeStatistics(std::ostream& out) const;
+};
+
+#endif
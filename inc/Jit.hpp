@@ -0,0 +1,56 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include <cstddef>
+#include <vector>
+
+class Emulator;
+struct DecodedInstruction;
+class X86Emitter;
+
+#define MAX_BLOCK_INSTRUCTIONS 64
+
+// translated block, gets the emulator's register array and returns the number of executed instructions
+typedef int (*JitBlock)(int* registers);
+
+// pending jump to the block exit which sets pc and the executed instruction count
+struct JitExit{
+  size_t patchPosition;
+  int pc;
+  int count;
+  JitExit(size_t pos, int p, int c) {patchPosition = pos; pc = p; count = c;}
+};
+
+class JitCompiler{
+private:
+  Emulator* emulator;
+  unsigned char* buffer;
+  size_t capacity;
+  size_t used;
+
+  JitBlock blocks[65536];
+  unsigned short hotness[65536];
+  bool translatedByte[65536 + 1];
+  bool flushed; // set when translations were thrown away, so the running block has to leave
+  std::vector<JitExit> exits;
+
+  JitBlock translate(int address);
+  bool canTranslate(const DecodedInstruction& instr);
+  bool isDirectBranch(const DecodedInstruction& instr);
+  void emitBranch(X86Emitter& e, const DecodedInstruction& instr, int address, int count);
+  void emitInstruction(X86Emitter& e, const DecodedInstruction& instr, int address, int count);
+  void emitLoadRegister(X86Emitter& e, int hostRegister, int guestRegister, int nextPc);
+  void emitStore(X86Emitter& e);
+
+  static int store(JitCompiler* jit, int address, int value);
+public:
+  JitCompiler(Emulator* e);
+  ~JitCompiler();
+
+  bool available() const {return buffer != nullptr;}
+  JitBlock blockAt(int address);
+  void invalidate(int address);
+  void flush();
+};
+
+#endif
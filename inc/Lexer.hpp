@@ -0,0 +1,74 @@
+#ifndef _LEXER_
+#define _LEXER_
+
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// read only mapping of an assembly source, lines are handed out as views into it
+class SourceFile {
+  private:
+    const char* data;
+    size_t size;
+    size_t position;
+  public:
+    SourceFile(const string& name);
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    bool nextLine(string_view& line);
+};
+
+enum class TokenKind {
+  WORD,        // [A-Za-z0-9_]+, symbols, literals and keywords alike
+  STRING,      // contents of a "..." literal
+  PUNCTUATION, // one of . : , $ % * [ ] +
+  END,         // end of the line or start of a comment
+  INVALID
+};
+
+struct Token {
+  TokenKind kind;
+  string_view text;
+  bool is(char c) const { return kind == TokenKind::PUNCTUATION && text[0] == c; }
+};
+
+enum class KeywordKind {
+  NONE,
+  MNEMONIC,  // value is an Instructions enumerator
+  DIRECTIVE, // value is a Directives enumerator
+  REGISTER   // value is the register number, psw is 8
+};
+
+struct Keyword {
+  string_view name;
+  KeywordKind kind;
+  int value;
+};
+
+// perfect hash lookup, words that are not keywords get an entry of kind NONE
+const Keyword& lookupKeyword(string_view word);
+
+// \d+ or 0x followed by hex digits, anything else in a word position is a symbol
+bool isLiteral(string_view word);
+
+// tokenizes one line, peek() is the token that next() will return
+class Lexer {
+  private:
+    string_view line;
+    size_t position;
+    Token current;
+
+    Token scan();
+  public:
+    Lexer(string_view l) : line(l), position(0) { current = scan(); }
+
+    const Token& peek() const { return current; }
+    Token next() { Token token = current; current = scan(); return token; }
+    bool accept(char c) { if (!current.is(c)) return false; next(); return true; }
+    bool atEnd() const { return current.kind == TokenKind::END; }
+};
+
+#endif
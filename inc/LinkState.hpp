@@ -0,0 +1,89 @@
+#ifndef _LINK_STATE_H_
+#define _LINK_STATE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Image.hpp"
+
+/* What "linker -incremental" keeps next to its output for the next run, written as a sequence of little endian
+ * fields after the magic and version. Everything a relink with the same layout needs is in it, so that the
+ * objects that did not change are not read again:
+ *
+ *  the options the layout depends on and every input with its size, modification time and content hash,
+ *  per object the shape of its symbols and sections, where its pieces went, the relocations it applied and
+ *  the symbols whose values it provided, the merged sections, the final symbol table and the image itself,
+ *  and last a hash of all of the above.
+ */
+
+#define LINK_STATE_MAGIC "SSLS"
+#define LINK_STATE_VERSION 1
+
+struct LinkStateInput{ // a file on the command line
+  std::string name;
+  uint64_t size;
+  int64_t modified; // nanoseconds
+  uint64_t hash;
+};
+
+struct LinkStatePiece{
+  uint32_t address; // where the object's section starts in the image
+  uint32_t size;
+};
+
+struct LinkStateSite{ // a relocation the object applied
+  uint32_t address;
+  uint32_t symbol;  // index in the symbol table below
+};
+
+struct LinkStateOrigin{ // a symbol whose value comes from the object, its address is base + the value in the object
+  uint32_t symbol;
+  int32_t base;
+};
+
+struct LinkStateObject{
+  std::string name;  // file, or archive(member)
+  uint32_t input;    // index of the file it came from
+  uint64_t shape;    // hash of everything but the bytes, the values and the relocations
+  std::vector<LinkStatePiece> pieces; // in the order of the object's section table
+  std::vector<LinkStateSite> sites;
+  std::vector<LinkStateOrigin> origins;
+};
+
+struct LinkStateSection{
+  std::string name;
+  int32_t startAddress;
+  int32_t size;
+};
+
+struct LinkStateSymbol{
+  std::string name;
+  int32_t value;
+  int32_t size; // -1 for everything but sections
+};
+
+struct LinkState{
+  std::string options;
+  std::vector<LinkStateInput> inputs;
+  std::vector<LinkStateObject> objects;
+  std::vector<LinkStateSection> sections;
+  std::vector<LinkStateSymbol> symbols;
+  std::vector<unsigned char> code;
+  std::vector<uint64_t> used;
+};
+
+#define LINK_STATE_HASH_BASIS 14695981039346656037ull
+
+uint64_t hashBytes(const unsigned char* data, size_t size, uint64_t hash = LINK_STATE_HASH_BASIS);
+uint64_t hashText(std::string_view text, uint64_t hash = LINK_STATE_HASH_BASIS); // with a terminator, so that neighbours do not run together
+uint64_t hashNumber(int64_t number, uint64_t hash = LINK_STATE_HASH_BASIS);
+// false if the file cannot be read
+bool statFile(const std::string& name, LinkStateInput& input);
+bool hashFile(const std::string& name, uint64_t& hash);
+
+// false if there is no usable state, in which case the link starts over
+bool readLinkState(const std::string& name, LinkState& state);
+void writeLinkState(const std::string& name, const LinkState& state);
+
+#endif
@@ -3,62 +3,143 @@
 
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <iostream>
 #include <algorithm>
 #include <regex>
+#include <memory>
+#include <map>
+#include <exception>
 #include "Exceptions.hpp"
 #include "SymbolTable.hpp"
-#include "RelTable.hpp"
+#include "Image.hpp"
+#include "ObjectFile.hpp"
+#include "Archive.hpp"
+#include "LinkState.hpp"
 
 using namespace std;
 
+// a section's contribution from one object, its bytes and relocations stay in the object and its symbols
+// were moved by its offset when it was appended
+struct SectionPiece{
+  const ObjectFile* object;
+  ObjectSection section;
+  uint32_t index; // in the object's section table
+  int offset;     // within the merged section
+};
+
+// where a part of a mergeable section's piece, from one of the object's labels to the next, went in the merged section
+struct MergedConstant{
+  int start; // in the object's section
+  int size;
+  int offset; // in the merged section
+};
+
 struct Section{
   string name;
-  vector<unsigned char> code;
+  int size;
+  vector<SectionPiece> pieces;
   int startAddress;
-  vector<RelocationEntry> relocationEntries;
-  vector<int> relocationEntryOffsets;
-  int sectionOccurence;
   bool placed;
-  Section() {name = "UND"; startAddress = 0; sectionOccurence = 0; placed = false;}
-  Section(string n, int start) {name = n; startAddress = start; sectionOccurence = 1; placed = false;}
-  Section(string n, vector<unsigned char> c) {name = n; code = c; startAddress = 0; sectionOccurence = 1; placed = false;}
-  Section(string n, vector<unsigned char> c, int start) {name = n; code = c; startAddress = start; sectionOccurence = 1; placed = false;}
+  Section() {name = "UND"; size = 0; startAddress = 0; placed = false;}
+  Section(string n) {name = n; size = 0; startAddress = 0; placed = false;}
+};
+
+// an input object with its symbols in the order they are resolved in, prepared on any thread
+struct InputObject{
+  string name;                 // file name, archive(member) for an archive member
+  const unsigned char* member; // the member's bytes in the archive's mapping, nullptr for a file
+  size_t memberSize;
+  size_t source;               // index of the file on the command line
+  unique_ptr<ObjectFile> object;
+  vector<uint32_t> symbols;                      // by name, without UND and without repeated names
+  unordered_map<int32_t, uint32_t> symbolNumbers; // symbol number -> index, to find a symbol's section
+  exception_ptr error;                           // reported when resolution reaches the input
+  InputObject(string n, size_t f, const unsigned char* m = nullptr, size_t s = 0) : name(n), member(m), memberSize(s), source(f) {}
 };
 
 class Linker{
   private:
     vector<string> input;
     string output;
+    vector<unique_ptr<ArchiveFile>> archives; // mapped until the output is written, their members are read in place
+    vector<string> archiveNames;
+    vector<size_t> archiveSources; // their indexes on the command line
+    vector<InputObject> objects; // every input is read once and kept until the output is written, members follow the files
     vector<Section> sections;
-    map<int, unsigned char> generatedCode;
+    unordered_map<string_view, int> sectionIndexes; // name -> index in sections, the names point into the objects
+    // symbols of every input file by the section number resolution gave them, the ones a fragment of the section moves
+    unordered_map<string_view, unordered_map<int, vector<Symbol*>>> fileSymbols;
+    vector<unsigned char> generatedCode; // flat image of the address space, 64K unless a section is placed past it
+    vector<uint64_t> usedAddresses;      // one bit per address of generatedCode that a section was packed to
     SymbolTable symbolTable;
-    SymbolTable localSymbolTable;
     // used to store the section of a symbol (symbol is key, section is value)
     unordered_map<string, string> helperSectionMap;
 
     bool hex;
     bool relocatable;
+    bool binary; // executable goes out as a binary image instead of a hex dump
+    int jobs;    // threads reading the inputs
+    bool incremental; // the output's link state is reused and kept up to date
+    bool verify;      // an incremental link is checked against a clean one
+    bool gcSections;  // only the sections reachable from the roots are linked
+    vector<vector<bool>> livePieces;          // per object and section, filled when gcSections is set
+    unordered_set<string_view> droppedSymbols; // defined in sections that were not linked
+    bool icf; // pieces identical to one before them are left out
+    map<pair<uint32_t, uint32_t>, pair<uint32_t, uint32_t>> foldedPieces; // (object, section) -> the piece kept for it
+    unordered_map<string_view, unordered_map<string_view, int>> constantPools; // per mergeable section, constant -> offset
+    map<pair<const ObjectFile*, string_view>, vector<MergedConstant>> mergedConstants; // per object and mergeable section
+    LinkState state;
   public:
-    Linker(vector<string> i, bool hex, bool rel, string o = "linkerOutput.hex");
+    Linker(vector<string> i, bool hex, bool rel, string o = "linkerOutput.hex", bool bin = false, int j = 1,
+      bool inc = false, bool ver = false, bool gc = false, bool icf = false);
     ~Linker() {}
 
     void link();
-    void parseSymbol(string line);
-    void resolveSymbols(string file);
-    void parseRelocationEntry(string line, int sectionIndex, int codeSize);
+    void loadObjects();
+    void buildImage();
+    string stateName() const {return output + ".state";}
+    string layoutOptions() const;
+    bool relinkIncrementally();
+    bool collectLinkState();
+    void collectSites(const Section& section, const SectionPiece& piece, const unordered_map<string_view, uint32_t>& symbolIndexes,
+      vector<LinkStateSite>& sites);
+    void readInputs(size_t first);
+    void resolveInputs(size_t first);
+    void loadArchiveMembers();
+    void resolveSymbols(const InputObject& input, string file);
+    int addSection(string_view name);
+    void appendSection(const ObjectFile& object, uint32_t index, const string& file);
+    bool appendConstants(const InputObject& input, uint32_t index);
+    void readSections(size_t index);
+    void collectGarbage();
+    bool pieceHash(const ObjectFile& object, const ObjectSection& section, uint64_t& hash);
+    bool identicalPieces(const ObjectFile& a, const ObjectSection& first, const ObjectFile& b, const ObjectSection& second);
+    void foldIdenticalSections();
+    void redirectFoldedSymbols();
+    void indexFileSymbols();
     void checkForUndefinedSymbols();
     void placeSections();
     void checkForOverlappingSections();
     void packCode();
-    void updateSymbolAndRelocationEntryValues();
+    void packSection(const Section& section);
+    bool isUsed(int address) const {return (usedAddresses[address >> 6] >> (address & 63)) & 1;}
+    int nextUsedAddress(int address) const;
+    int usedRunEnd(int address) const;
+    void updateSymbolValues();
     void resolveRelocationEntries();
+    void resolvePieceRelocations(const Section& section, const SectionPiece& piece);
+    void patchWord(int address, int addition);
     
     bool sectionExists(string name);
-    int getSectionIndex(string name);
+    int getSectionIndex(string_view name);
 
+    string formHexText();
     ofstream& formHexOutput(ofstream& output);
+    string formBinaryOutput();
+    string formOutput() {return binary ? formBinaryOutput() : formHexText();}
+    void formRelocatableOutput(ofstream& output);
     void formHexCout();
 };
 
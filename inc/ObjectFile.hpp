@@ -0,0 +1,102 @@
+#ifndef _OBJECT_FILE_H_
+#define _OBJECT_FILE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Image.hpp"
+
+/* Binary relocatable object written by the assembler and mapped by the linker, all fields little endian.
+ *
+ *  header       40 bytes, ObjectHeader
+ *  symbols      symbolCount entries of 24 bytes, ObjectSymbol, sorted by name
+ *  sections     sectionCount entries of 20 bytes, ObjectSection, in order of appearance
+ *  relocations  relocationCount entries of 12 bytes, ObjectRelocation, grouped by section
+ *  strings      zero terminated names, symbols and sections point into them
+ *  section data bytes of every section, at the offsets in the section table
+ */
+
+#define OBJECT_MAGIC "SSOB"
+#define OBJECT_VERSION 1
+#define OBJECT_HEADER_SIZE 40
+#define OBJECT_SYMBOL_SIZE 24
+#define OBJECT_SECTION_SIZE 20
+#define OBJECT_RELOCATION_SIZE 12
+
+#define OBJECT_SYMBOL_GLOBAL 1
+#define OBJECT_SYMBOL_EXTERN 2
+
+struct ObjectHeader{
+  char magic[4];
+  uint16_t version;
+  uint16_t flags;
+  uint32_t symbolCount;
+  uint32_t sectionCount;
+  uint32_t relocationCount;
+  uint32_t symbolTable; // file offsets of the tables
+  uint32_t sectionTable;
+  uint32_t relocationTable;
+  uint32_t stringTable;
+  uint32_t stringSize;
+};
+
+struct ObjectSymbol{
+  uint32_t name; // offset in the string table
+  int32_t number;
+  int32_t sectionNumber;
+  int32_t value;
+  int32_t size; // -1 for everything but sections
+  uint32_t flags;
+};
+
+struct ObjectSection{
+  uint32_t name;
+  uint32_t offset; // file offset of the section's bytes
+  uint32_t size;
+  uint32_t firstRelocation;
+  uint32_t relocationCount;
+};
+
+struct ObjectRelocation{
+  uint32_t offset; // within the section
+  uint32_t symbol; // index in the symbol table
+  uint32_t type;   // TypeOfUse
+};
+
+// lays the tables out in the order above, the section offsets are assigned here and bytes[i] holds sections[i].size bytes
+std::vector<unsigned char> writeObject(const std::vector<ObjectSymbol>& symbols, const std::vector<ObjectSection>& sections,
+  const std::vector<const unsigned char*>& bytes, const std::vector<ObjectRelocation>& relocations, const std::string& strings);
+
+/* An object file read once. Binary objects are mapped, text ones are translated into the same layout in memory,
+ * so both are read through the same accessors. The tables are checked against the size when the file is opened. */
+class ObjectFile{
+  void* mapping;
+  size_t size;
+  const unsigned char* data;
+  std::vector<unsigned char> translated; // layout of a text object
+  ObjectHeader header;
+
+  void translateText(std::string_view text);
+  void readHeader();
+public:
+  ObjectFile(const std::string& name);
+  // a binary object inside a larger mapping, such as an archive member, which has to outlive it
+  ObjectFile(const unsigned char* contents, size_t length);
+  ~ObjectFile();
+  ObjectFile(const ObjectFile&) = delete;
+  ObjectFile& operator=(const ObjectFile&) = delete;
+
+  uint32_t symbolCount() const {return header.symbolCount;}
+  uint32_t sectionCount() const {return header.sectionCount;}
+  ObjectSymbol symbol(uint32_t index) const;
+  ObjectSection section(uint32_t index) const;
+  ObjectRelocation relocation(uint32_t index) const;
+  std::string_view string(uint32_t offset) const {return std::string_view((const char*)data + header.stringTable + offset);}
+  const unsigned char* bytes(const ObjectSection& section) const {return data + section.offset;}
+  // the whole object in the binary layout, also for a translated text object
+  const unsigned char* contents() const {return data;}
+  size_t length() const {return size;}
+};
+
+#endif
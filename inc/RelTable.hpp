@@ -1,6 +1,7 @@
 #ifndef _RELTABLE_
 #define _RELTABLE_
 
+#include <map>
 #include "SymbolTable.hpp"
 
 struct RelocationEntry{
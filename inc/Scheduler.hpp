@@ -0,0 +1,39 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <vector>
+
+// devices which can have a pending event, at most one each
+enum Devices{
+  DEVICE_TIMER,
+  DEVICE_INPUT,    // next scripted terminal character
+  DEVICE_LIMIT,    // instruction budget
+  DEVICE_WATCHDOG, // wall clock limit
+  DEVICE_FLUSH,    // terminal output interval when no reader thread keeps time
+  DEVICE_COUNT
+};
+
+struct ScheduledEvent{
+  unsigned long long due; // instruction count at which the event fires
+  int device;
+  unsigned generation; // events of an older generation were cancelled
+  ScheduledEvent(unsigned long long d, int dev, unsigned g) {due = d; device = dev; generation = g;}
+};
+
+// pending device events in virtual time, kept in a min-heap by their due instruction count
+class EventScheduler{
+private:
+  std::vector<ScheduledEvent> heap;
+  unsigned generations[DEVICE_COUNT] = {0};
+
+  void dropCancelled();
+public:
+  static const unsigned long long NEVER = ~0ULL;
+
+  void schedule(int device, unsigned long long due); // replaces the device's pending event
+  void cancel(int device);
+  unsigned long long nextDue(); // NEVER if there is nothing pending
+  int popDue(unsigned long long now); // device of the next due event or -1
+};
+
+#endif
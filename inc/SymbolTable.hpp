@@ -1,9 +1,10 @@
 #ifndef _SYMBOLTABLE_
 #define _SYMBOLTABLE_
 
-#include <map>
 #include <vector>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <iostream>
 
 enum class TypeOfUse{
@@ -15,20 +16,18 @@ enum class TypeOfUse{
 
 struct SymbolUsage{
   int offset;
-  std::string sectionName;
+  int section; // index of the section the use is in, sections are numbered in order of appearance
   TypeOfUse typeOfUse;
-  SymbolUsage() {offset = 0; sectionName = ""; typeOfUse = TypeOfUse::UNKNOWN;}
-  SymbolUsage(int off, std::string secName, TypeOfUse t) {
+  SymbolUsage() {offset = 0; section = -1; typeOfUse = TypeOfUse::UNKNOWN;}
+  SymbolUsage(int off, int sec, TypeOfUse t) {
     offset = off;
-    sectionName = secName;
+    section = sec;
     typeOfUse = t;
   }
 };
 
 struct Symbol{
-  static int nextNumber;
-  static int currentSectionNumber;
-  std::string name;
+  std::string_view name; // interned in the table's arena, always followed by a '\0'
   int sectionNumber;
   int value;
   bool isGlobal;
@@ -36,77 +35,73 @@ struct Symbol{
   int number;
   int size; //for sections
   std::vector<SymbolUsage> backpatch;
-  std::string originFile; // for linker
-  
-  Symbol() {name = ""; sectionNumber = 0; value = 0; isGlobal = false; isExtern = false; number = 0; size = -1; originFile = "";}
-  Symbol(std::string n, int val, bool isGl, bool isExt, int s, bool isDef, std::string f = "") { //isDef true for sections
-    name = n;
-    value = val;
-    isGlobal = isGl;
-    isExtern = isExt;
-    number = nextNumber++;
-    size = s;
-    if (!isDef) sectionNumber = 0;
-    else {
-      if (s != -1) { //if symbol is a section
-        sectionNumber = currentSectionNumber = number;
-      }
-      else sectionNumber = currentSectionNumber;
-    }
-    originFile = f;
-  }
-  Symbol(std::string n, int val, bool isGl, bool isExt, int s, int secNum, std::string f = "") {
-    name = n;
-    value = val;
-    isGlobal = isGl;
-    isExtern = isExt;
-    number = nextNumber++;
-    size = s;
-    sectionNumber = secNum;
-    originFile = f;
-  }
-  Symbol(std::string n, int val, bool isGl, bool isExt, int s, bool isDef, SymbolUsage usage, std::string f = "") { //isDef true for sections
-    name = n;
-    value = val;
-    isGlobal = isGl;
-    isExtern = isExt;
-    number = nextNumber++;
-    size = s;
-    if (!isDef) sectionNumber = 0;
-    else {
-      if (s != -1) { //if symbol is a section
-        sectionNumber = currentSectionNumber = number;
-      }
-      else sectionNumber = currentSectionNumber;
-    }
-    backpatch.push_back(usage);
-    originFile = f;
-  }
+  std::string_view originFile; // for linker
+
+  Symbol() {sectionNumber = 0; value = 0; isGlobal = false; isExtern = false; number = 0; size = -1;}
   bool isOnlyExtern() {return isExtern && !isGlobal;}
   bool isOnlyGlobal() {return !isExtern && isGlobal;}
   bool isSection() {return size != -1;}
 };
 
+// append only storage for names, views into it stay valid until the arena is cleared
+class NameArena{
+  std::vector<std::unique_ptr<char[]>> blocks;
+  size_t used;
+  size_t capacity;
+public:
+  NameArena() : used(0), capacity(0) {}
+  std::string_view intern(std::string_view text);
+  void clear();
+};
+
+/* Symbols are stored contiguously in order of insertion. Names are found through an open addressing
+ * index of symbol positions and numbers through a dense vector. A Symbol* stays valid until the
+ * next symbol is added. */
 class SymbolTable{
+  std::vector<Symbol> symbols;
+  std::vector<int> nameIndex;   // slot -> position in symbols, -1 for an empty slot
+  std::vector<int> numberIndex; // number -> position in symbols, -1 if no symbol has the number
+  NameArena names;
+  std::string_view lastOrigin;
+
+  void growNameIndex();
 public:
   friend class RelocationTable;
 
-  std::map<std::string, Symbol*> table;
-  static std::string currentSection;
+  // numbering and the open section belong to the table so that every unit has its own
+  int nextNumber;
+  int currentSectionNumber;
+  std::string currentSection;
+
+  // numbers a new symbol and inserts it under its name, isDef places it in the current section
+  // and a defined symbol with a size (s != -1) opens a new section
+  Symbol* addSymbol(std::string_view n, int val, bool isGl, bool isExt, int s, bool isDef, std::string_view f = "");
+  Symbol* addSymbol(std::string_view n, int val, bool isGl, bool isExt, int s, bool isDef, SymbolUsage usage);
+  // inserts a symbol that already has its number and section, nullptr if the name is taken
+  Symbol* insertSymbol(std::string_view n, int val, bool isGl, bool isExt, int s, int secNum, int num, std::string_view f = "");
 
-  Symbol* getSymbolByKey(std::string key);
+  // copies text into the table's arena, for views that have to live as long as the table
+  std::string_view intern(std::string_view text) {return names.intern(text);}
+
+  Symbol* getSymbolByKey(std::string_view key);
   Symbol* getSymbolByNumber(int number);
-  bool updateSectionSize(std::string key, int size);
-  void addSymbolUsage(std::string key, SymbolUsage usage);
-  void defineAndUpdateSymbol(std::string key, int lc);
-  bool isSection(std::string key);
-  void removeSymbol(std::string key);
+  bool updateSectionSize(std::string_view key, int size);
+  void addSymbolUsage(std::string_view key, SymbolUsage usage);
+  void defineAndUpdateSymbol(std::string_view key, int lc);
+  bool isSection(std::string_view key);
   void emptyTable();
 
-  friend std::ostream& operator<<(std::ostream& os, const SymbolTable& table);
+  // insertion order, for passes that do not depend on the order
+  std::vector<Symbol>::iterator begin() {return symbols.begin();}
+  std::vector<Symbol>::iterator end() {return symbols.end();}
+  size_t size() const {return symbols.size();}
+  // name order, which is the order symbols are written and resolved in
+  std::vector<Symbol*> sortedByName();
+
+  friend std::ostream& operator<<(std::ostream& os, SymbolTable& table);
 
   SymbolTable();
-  ~SymbolTable();
+  ~SymbolTable() {}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,78 @@
+#ifndef _TERMINAL_H_
+#define _TERMINAL_H_
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <cstdio>
+
+// host side of the emulated terminal, a reader thread fills the input ring and the cpu loop only polls it
+class Terminal{
+public:
+  enum FlushPolicy{
+    FLUSH_ON_NEWLINE, // output is written out when a line is complete
+    FLUSH_ON_HALT,    // output is written out when the emulator stops
+    FLUSH_EVERY_INTERVAL // output is written out at most interval microseconds after it was produced, virtual ones
+                         // when headless, as there is no reader thread to keep time then
+  };
+private:
+  static const unsigned RING_SIZE = 4096; // power of two
+  static const size_t OUTPUT_LIMIT = 4096; // output is written out when the buffer grows past this
+
+  unsigned char ring[RING_SIZE];
+  std::atomic<unsigned> head; // advanced only by the reader thread
+  std::atomic<unsigned> tail; // advanced only by the cpu thread
+
+  std::atomic<bool> running;
+  std::atomic<bool> flushDue; // raised by the reader thread when the interval elapses
+  std::thread reader;
+
+  std::string output;
+  FILE* out;
+  std::string* capture; // output is collected here instead of written to out when set
+  bool interactive; // headless terminals get their input from a script instead of stdin
+  FlushPolicy policy;
+  int interval; // microseconds
+
+  void readInput();
+public:
+  Terminal(FlushPolicy p = FLUSH_EVERY_INTERVAL, int intervalMicroseconds = 10000);
+  ~Terminal();
+
+  void configure(FlushPolicy p, int intervalMicroseconds);
+  void setOutput(FILE* o) {out = o;}
+  void captureOutput(std::string* c) {capture = c;}
+  bool sharesStdout() const {return capture == nullptr && out == stdout;}
+  void setInteractive(bool i) {interactive = i;}
+  // the cpu loop has to call flush() every interval
+  bool needsFlushTicks() const {return !interactive && policy == FLUSH_EVERY_INTERVAL;}
+  int flushInterval() const {return interval;}
+  void start();
+  void stop();
+
+  // next input character or -1 when none arrived, called once per emulated instruction
+  int read() {
+    unsigned t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return -1;
+    unsigned char c = ring[t & (RING_SIZE - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return c;
+  }
+
+  void write(unsigned char c) {
+    output += (char)c;
+    if ((c == '\n' && policy == FLUSH_ON_NEWLINE) || output.size() >= OUTPUT_LIMIT) flush();
+  }
+
+  // writes the output out if the flush interval elapsed
+  void poll() {
+    if (flushDue.load(std::memory_order_relaxed)) {
+      flushDue.store(false, std::memory_order_relaxed);
+      if (!output.empty()) flush();
+    }
+  }
+
+  void flush();
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "../inc/Archive.hpp"
+#include "../inc/Exceptions.hpp"
+#include "../inc/ObjectFile.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+
+std::vector<unsigned char> writeArchive(const std::vector<std::string>& names, const std::vector<const ObjectFile*>& members) {
+  std::string strings;
+  std::vector<ArchiveMember> entries;
+  std::vector<std::pair<std::string_view, uint32_t>> index;
+  std::unordered_set<std::string_view> defined;
+  for (size_t i = 0; i < members.size(); i++) {
+    entries.push_back(ArchiveMember{(uint32_t)strings.size(), 0, (uint32_t)members[i]->length()});
+    strings += names[i];
+    strings += '\0';
+    for (uint32_t j = 0; j < members[i]->symbolCount(); j++) {
+      ObjectSymbol symbol = members[i]->symbol(j);
+      bool definesGlobal = (symbol.flags & OBJECT_SYMBOL_GLOBAL) && !(symbol.flags & OBJECT_SYMBOL_EXTERN) &&
+        symbol.size == -1 && symbol.sectionNumber != 0;
+      std::string_view name = members[i]->string(symbol.name);
+      if (definesGlobal && defined.insert(name).second) index.push_back({name, (uint32_t)i});
+    }
+  }
+  sort(index.begin(), index.end());
+  std::vector<ArchiveSymbol> symbols;
+  for (auto& entry: index) {
+    symbols.push_back(ArchiveSymbol{(uint32_t)strings.size(), entry.second});
+    strings += entry.first;
+    strings += '\0';
+  }
+
+  uint32_t memberTable = ARCHIVE_HEADER_SIZE;
+  uint32_t symbolTable = memberTable + entries.size() * ARCHIVE_MEMBER_SIZE;
+  uint32_t stringTable = symbolTable + symbols.size() * ARCHIVE_SYMBOL_SIZE;
+  uint32_t data = stringTable + strings.size();
+  for (ArchiveMember& entry: entries) {
+    data = (data + 3) & ~3u;
+    entry.offset = data;
+    data += entry.size;
+  }
+
+  std::vector<unsigned char> archive(data, 0);
+  unsigned char* p = archive.data();
+  memcpy(p, ARCHIVE_MAGIC, 4);
+  writeImage16(p + 4, ARCHIVE_VERSION);
+  writeImage16(p + 6, 0);
+  writeImage32(p + 8, entries.size());
+  writeImage32(p + 12, symbols.size());
+  writeImage32(p + 16, memberTable);
+  writeImage32(p + 20, symbolTable);
+  writeImage32(p + 24, stringTable);
+  writeImage32(p + 28, strings.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    unsigned char* entry = p + memberTable + i * ARCHIVE_MEMBER_SIZE;
+    writeImage32(entry, entries[i].name);
+    writeImage32(entry + 4, entries[i].offset);
+    writeImage32(entry + 8, entries[i].size);
+    memcpy(p + entries[i].offset, members[i]->contents(), entries[i].size);
+  }
+  for (size_t i = 0; i < symbols.size(); i++) {
+    unsigned char* entry = p + symbolTable + i * ARCHIVE_SYMBOL_SIZE;
+    writeImage32(entry, symbols[i].name);
+    writeImage32(entry + 4, symbols[i].member);
+  }
+  memcpy(p + stringTable, strings.data(), strings.size());
+  return archive;
+}
+
+ArchiveFile::ArchiveFile(const std::string& name) : mapping(nullptr), size(0), data(nullptr) {
+  int descriptor = open(name.c_str(), O_RDONLY);
+  if (descriptor < 0) throw UnknownFileError(name.c_str());
+  struct stat status;
+  bool readable = fstat(descriptor, &status) == 0 && status.st_size >= ARCHIVE_HEADER_SIZE;
+  if (readable) {
+    mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    readable = mapping != MAP_FAILED;
+  }
+  close(descriptor);
+  if (!readable) {
+    mapping = nullptr;
+    throw InvalidArchiveError();
+  }
+  size = status.st_size;
+  data = (const unsigned char*)mapping;
+
+  memcpy(header.magic, data, 4);
+  header.version = readImage16(data + 4);
+  header.flags = readImage16(data + 6);
+  header.memberCount = readImage32(data + 8);
+  header.symbolCount = readImage32(data + 12);
+  header.memberTable = readImage32(data + 16);
+  header.symbolTable = readImage32(data + 20);
+  header.stringTable = readImage32(data + 24);
+  header.stringSize = readImage32(data + 28);
+
+  // the tables are checked here, the members themselves when they are loaded
+  bool valid = memcmp(header.magic, ARCHIVE_MAGIC, 4) == 0 && header.version == ARCHIVE_VERSION &&
+    (uint64_t)header.memberTable + (uint64_t)header.memberCount * ARCHIVE_MEMBER_SIZE <= size &&
+    (uint64_t)header.symbolTable + (uint64_t)header.symbolCount * ARCHIVE_SYMBOL_SIZE <= size &&
+    (uint64_t)header.stringTable + header.stringSize <= size &&
+    (header.stringSize == 0 || data[header.stringTable + header.stringSize - 1] == '\0');
+  for (uint32_t i = 0; valid && i < header.memberCount; i++) {
+    ArchiveMember m = member(i);
+    valid = m.name < header.stringSize && (uint64_t)m.offset + m.size <= size;
+  }
+  for (uint32_t i = 0; valid && i < header.symbolCount; i++) { // the lookup needs the names in order
+    ArchiveSymbol s = symbol(i);
+    valid = s.name < header.stringSize && s.member < header.memberCount && (i == 0 || string(symbol(i - 1).name) < string(s.name));
+  }
+  if (!valid) {
+    munmap(mapping, size);
+    mapping = nullptr;
+    throw InvalidArchiveError();
+  }
+}
+
+ArchiveFile::~ArchiveFile() {
+  if (mapping != nullptr) munmap(mapping, size);
+}
+
+ArchiveMember ArchiveFile::member(uint32_t index) const {
+  const unsigned char* entry = data + header.memberTable + index * ARCHIVE_MEMBER_SIZE;
+  return ArchiveMember{readImage32(entry), readImage32(entry + 4), readImage32(entry + 8)};
+}
+
+ArchiveSymbol ArchiveFile::symbol(uint32_t index) const {
+  const unsigned char* entry = data + header.symbolTable + index * ARCHIVE_SYMBOL_SIZE;
+  return ArchiveSymbol{readImage32(entry), readImage32(entry + 4)};
+}
+
+int ArchiveFile::findSymbol(std::string_view name) const {
+  uint32_t low = 0, high = header.symbolCount;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (string(symbol(middle).name) < name) low = middle + 1;
+    else high = middle;
+  }
+  if (low == header.symbolCount) return -1;
+  ArchiveSymbol found = symbol(low);
+  return string(found.name) == name ? (int)found.member : -1;
+}
@@ -0,0 +1,35 @@
+#include "../inc/Archive.hpp"
+#include "../inc/ObjectFile.hpp"
+#include "../inc/Exceptions.hpp"
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <cstring>
+
+using namespace std;
+
+// archiver -o lib.a a.o b.o ..., text objects are stored in the binary layout
+int main(int argc, char* argv[]) {
+  try {
+    const char* op = "-o";
+    if (argc < 4 || strcmp(argv[1], op) != 0) throw InvalidCmdArgs();
+
+    vector<string> names;
+    vector<unique_ptr<ObjectFile>> objects;
+    vector<const ObjectFile*> members;
+    for (int i = 3; i < argc; i++) {
+      objects.emplace_back(new ObjectFile(argv[i]));
+      names.push_back(argv[i]);
+      members.push_back(objects.back().get());
+    }
+
+    vector<unsigned char> archive = writeArchive(names, members);
+    ofstream output(argv[2], ios::binary);
+    output.write((const char*)archive.data(), archive.size());
+    output.close();
+  }
+  catch(const exception& e) {
+    cout << e.what() << '\n';
+  }
+  return 0;
+}
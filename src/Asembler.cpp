@@ -1,12 +1,12 @@
 #include "../inc/Asembler.hpp"
+#include "../inc/HexCodec.hpp"
 #include <fstream>
 #include <algorithm>
 #include <sstream>
 #include <unordered_map>
+#include <thread>
+#include <atomic>
 
-int Asembler::lineCnt = 1;
-int Asembler::lc = 0;
-int Asembler::sectionIndexForGeneratedCode = 0;
 unordered_map<Instructions, unsigned char> instructionOperationCodes = {
   {HALT, 0x00},
   {INT, 0x10},
@@ -37,252 +37,83 @@ unordered_map<Instructions, unsigned char> instructionOperationCodes = {
 };
 
 /* friend/helper functions */
-string deleteSpaces(string str){
-  str.erase(remove(str.begin(), str.end(), ' '), str.end());
-  return str;
+// register operand, -1 if the next token is not a register name
+int parseRegister(Lexer& lexer) {
+  const Token& token = lexer.peek();
+  if (token.kind != TokenKind::WORD) return -1;
+  const Keyword& keyword = lookupKeyword(token.text);
+  if (keyword.kind != KeywordKind::REGISTER) return -1;
+  lexer.next();
+  return keyword.value;
 }
 
-const std::string WHITESPACE = " \n\r\t\f\v";
- 
-std::string ltrim(const std::string &s)
-{
-    size_t start = s.find_first_not_of(WHITESPACE);
-    return (start == std::string::npos) ? "" : s.substr(start);
-}
- 
-std::string rtrim(const std::string &s)
-{
-    size_t end = s.find_last_not_of(WHITESPACE);
-    return (end == std::string::npos) ? "" : s.substr(0, end + 1);
-}
- 
-std::string trim(const std::string &s) {
-    return rtrim(ltrim(s));
+// reg , reg
+int parseRegisters(Lexer& lexer) {
+  int regDest = parseRegister(lexer);
+  if (regDest < 0 || !lexer.accept(',')) return -1;
+  int regSrc = parseRegister(lexer);
+  if (regSrc < 0) return -1;
+  return (regDest << 4) | regSrc;
 }
 
-vector<string> commaSeparatedListToVector(string list) {
-  stringstream sstr(list);
-  vector<string> vec;
-  while (sstr.good()) {
-    string substr;
-    getline(sstr, substr, ',');
-    vec.push_back(substr);
+// word operand: a register if allowed, then a literal, then a symbol
+Operand wordOperand(const Token& token, AddressModes registerMode, AddressModes literalMode, AddressModes symbolMode) {
+  if (token.kind != TokenKind::WORD) return Operand();
+  if (registerMode != AddressModes::INVALID) {
+    const Keyword& keyword = lookupKeyword(token.text);
+    if (keyword.kind == KeywordKind::REGISTER) return Operand(registerMode, string(""), keyword.value);
   }
-  return vec;
-}
-
-Directives enumerateDirective(string dir){
-  if (dir == "global") return GLOBAL;
-  if (dir == "extern") return EXTERN;
-  if (dir == "section") return SECTION;
-  if (dir == "word") return WORD;
-  if (dir == "skip") return SKIP;
-  if (dir == "ascii") return ASCII;
-  if (dir == "end") return END;
-  return Directives::INVALID;
+  return Operand(isLiteral(token.text) ? literalMode : symbolMode, string(token.text));
 }
 
-Instructions enumerateInstruction(string instr) {
-  if (instr == "halt") return HALT;
-  if (instr == "int") return INT;
-  if (instr == "iret") return IRET;
-  if (instr == "call") return CALL;
-  if (instr == "ret") return RET;
-  if (instr == "jmp") return JMP;
-  if (instr == "jeq") return JEQ;
-  if (instr == "jne") return JNE;
-  if (instr == "jgt") return JGT;
-  if (instr == "push") return PUSH;
-  if (instr == "pop") return POP;
-  if (instr == "xchg") return XCHG;
-  if (instr == "add") return ADD;
-  if (instr == "sub") return SUB;
-  if (instr == "mul") return MUL;
-  if (instr == "div") return DIV;
-  if (instr == "cmp") return CMP;
-  if (instr == "not") return NOT;
-  if (instr == "and") return AND;
-  if (instr == "or") return OR;
-  if (instr == "xor") return XOR;
-  if (instr == "test") return TEST;
-  if (instr == "shl") return SHL;
-  if (instr == "shr") return SHR;
-  if (instr == "ldr") return LDR;
-  if (instr == "str") return STR;
-  return Instructions::ERROR;
+// the part after '[': reg ] or reg + literal ] or reg + symbol ]
+Operand parseIndirectOperand(Lexer& lexer) {
+  int regNumber = parseRegister(lexer);
+  if (regNumber < 0) return Operand();
+  if (lexer.accept(']')) return Operand(AddressModes::REGISTER_INDIRECT, string(""), regNumber);
+  if (!lexer.accept('+')) return Operand();
+  Operand op = wordOperand(lexer.next(), AddressModes::INVALID,
+    AddressModes::REGISTER_INDIRECT_OFFSET_LITERAL, AddressModes::REGISTER_INDIRECT_OFFSET_SYMBOL);
+  if (!lexer.accept(']')) return Operand();
+  op.regNumber = regNumber;
+  return op;
 }
 
-unsigned char parseDestRegister(smatch match) {
-  int regDest;
-  string arbitrary = match[2];
-  if (match[2].length() != 0) regDest = stoi(arbitrary);
-  else {
-    if (match[1] == "pc") regDest = 7;
-    else if (match[1] == "sp") regDest = 6;
-    else regDest = 8;
+Operand parseDataOperand(Lexer& lexer) {
+  Token token = lexer.next();
+  if (token.is('$'))
+    return wordOperand(lexer.next(), AddressModes::INVALID, AddressModes::IMMEDIATE_LITERAL, AddressModes::IMMEDIATE_SYMBOL);
+  if (token.is('%')) {
+    token = lexer.next();
+    if (token.kind != TokenKind::WORD) return Operand();
+    return Operand(AddressModes::PC_RELATIVE, string(token.text));
   }
-  regDest <<= 4;
-  regDest |= 0xF;
-  return (unsigned char)regDest;
+  if (token.is('[')) return parseIndirectOperand(lexer);
+  return wordOperand(token, AddressModes::REGISTER_DIRECT, AddressModes::MEMORY_DIRECT_LITERAL, AddressModes::MEMORY_DIRECT_SYMBOL);
 }
 
-unsigned char parseRegisters(smatch match) {
-  int regDescr = 0;
-  int regDest, regSrc;
-  string arbitrary = match[2];
-  if (match[2].length() != 0) regDest = stoi(arbitrary);
-  else {
-    if (match[1] == "pc") regDest = 7;
-    else if (match[1] == "sp") regDest = 6;
-    else regDest = 8;
+Operand parseAddressOperand(Lexer& lexer) {
+  Token token = lexer.next();
+  if (token.is('*')) {
+    if (lexer.accept('[')) return parseIndirectOperand(lexer);
+    return wordOperand(lexer.next(), AddressModes::REGISTER_DIRECT, AddressModes::MEMORY_DIRECT_LITERAL, AddressModes::MEMORY_DIRECT_SYMBOL);
   }
-  arbitrary = match[4];
-  if (match[4].length() != 0) regSrc = stoi(arbitrary);
-  else {
-    if (match[3] == "pc") regSrc = 7;
-    else if (match[3] == "sp") regSrc = 6;
-    else regSrc = 8;
+  if (token.is('%')) {
+    token = lexer.next();
+    if (token.kind != TokenKind::WORD) return Operand();
+    return Operand(AddressModes::PC_RELATIVE, string(token.text));
   }
-  regDest <<= 4;
-  regDescr |= regDest;
-  regDescr |= regSrc;
-  return (unsigned char)regDescr;
+  return wordOperand(token, AddressModes::INVALID, AddressModes::IMMEDIATE_LITERAL, AddressModes::IMMEDIATE_SYMBOL);
 }
 
-Operand parseDataOperand(string operand) {
-  regex reg;
-  smatch match;
-  int regNumber;
-  string op;
-
-  reg = ("^\\$(\\d+|0x[0-9a-fA-F]+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::IMMEDIATE_LITERAL, match[1]);
-
-  reg = ("^\\$(\\w+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::IMMEDIATE_SYMBOL, match[1]);
-
-  reg = ("^%(\\w+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::PC_RELATIVE, match[1]);
-
-  reg = ("^\\[(r([0-7])|pc|sp|psw)\\]$");
-  if (regex_search(operand, match, reg)) {
-    if (match[2].length() == 0) {
-      if (match[1] == "pc") regNumber = 7;
-      else if (match[1] == "sp") regNumber = 6;
-      else regNumber = 8;
-      return Operand(AddressModes::REGISTER_INDIRECT, string(""), regNumber);
-    } 
-    else {op = match[2]; return Operand(AddressModes::REGISTER_INDIRECT, string(""), stoi(op));}
-  }
-
-  reg = ("^\\[(r([0-7])|pc|sp|psw) \\+ (\\d+|0x[0-9a-fA-F]+)\\]$");
-  if (regex_search(operand, match, reg)) {
-    if (match[2].length() == 0) {
-      if (match[1] == "pc") regNumber = 7;
-      else if (match[1] == "sp") regNumber = 6;
-      else regNumber = 8;
-      return Operand(AddressModes::REGISTER_INDIRECT_OFFSET_LITERAL, match[3], regNumber);
-    }
-    else {op = match[2]; return Operand(AddressModes::REGISTER_INDIRECT_OFFSET_LITERAL, match[3], stoi(op));}
-  }
-
-  reg = ("^\\[(r([0-7])|pc|sp|psw) \\+ (\\w+)\\]$");
-  if (regex_search(operand, match, reg)) {
-    if (match[2].length() == 0) {
-      if (match[1] == "pc") regNumber = 7;
-      else if (match[1] == "sp") regNumber = 6;
-      else regNumber = 8;
-      return Operand(AddressModes::REGISTER_INDIRECT_OFFSET_SYMBOL, match[3], regNumber);
-    }
-    else {op = match[2]; return Operand(AddressModes::REGISTER_INDIRECT_OFFSET_SYMBOL, match[3], stoi(op));}
-  }
-
-  reg = ("^(r([0-7])|pc|sp|psw)$");
-  if (regex_search(operand, match, reg)) {
-    if (match[2].length() == 0) {
-      if (match[1] == "pc") regNumber = 7;
-      else if (match[1] == "sp") regNumber = 6;
-      else regNumber = 8;
-      return Operand(AddressModes::REGISTER_DIRECT, string(""), regNumber);
-    }
-    else {op = match[2]; return Operand(AddressModes::REGISTER_DIRECT, string(""), stoi(op));}
-  }
-
-  reg = ("^(\\d+|0x[0-9a-fA-F]+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::MEMORY_DIRECT_LITERAL, match[1]);
-
-  reg = ("^(\\w+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::MEMORY_DIRECT_SYMBOL, match[1]);
-
-  return Operand();
-}
-
-Operand parseAddressOperand(string operand) {
-  regex reg;
-  smatch match;
-  int regNumber;
-  string op;
-
-  reg = ("^\\*(r([0-7])|pc|sp|psw)$");
-  if (regex_search(operand, match, reg)) {
-    if (match[2].length() == 0) {
-      if (match[1] == "pc") regNumber = 7;
-      else if (match[1] == "sp") regNumber = 6;
-      else regNumber = 8;
-      return Operand(AddressModes::REGISTER_DIRECT, string(""), regNumber);
-    }
-    else {op = match[2]; return Operand(AddressModes::REGISTER_DIRECT, string(""), stoi(op));}
-  }
-    
-  reg = ("^\\*(\\d+|0x[0-9a-fA-F]+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::MEMORY_DIRECT_LITERAL, match[1]);
-
-  reg = ("^\\*(\\w+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::MEMORY_DIRECT_SYMBOL, match[1]);
-
-  reg = ("^%(\\w+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::PC_RELATIVE, match[1]);
-
-  reg = ("^\\*\\[(r([0-7])|pc|sp|psw)\\]$");
-  if (regex_search(operand, match, reg)) {
-    if (match[2].length() == 0) {
-      if (match[1] == "pc") regNumber = 7;
-      else if (match[1] == "sp") regNumber = 6;
-      else regNumber = 8;
-      return Operand(AddressModes::REGISTER_INDIRECT, string(""), regNumber);
-    } 
-    else {op = match[2]; return Operand(AddressModes::REGISTER_INDIRECT, string(""), stoi(op));}
-  }
-
-  reg = ("^\\*\\[(r([0-7])|pc|sp|psw) \\+ (\\d+|0x[0-9a-fA-F]+)\\]$");
-  if (regex_search(operand, match, reg)) {
-    if (match[2].length() == 0) {
-      if (match[1] == "pc") regNumber = 7;
-      else if (match[1] == "sp") regNumber = 6;
-      else regNumber = 8;
-      return Operand(AddressModes::REGISTER_INDIRECT_OFFSET_LITERAL, match[3], regNumber);
-    }
-    else {op = match[2]; return Operand(AddressModes::REGISTER_INDIRECT_OFFSET_LITERAL, match[3], stoi(op));}
-  }
-
-  reg = ("^\\*\\[(r([0-7])|pc|sp|psw) \\+ (\\w+)\\]$");
-  if (regex_search(operand, match, reg)) {
-    if (match[2].length() == 0) {
-      if (match[1] == "pc") regNumber = 7;
-      else if (match[1] == "sp") regNumber = 6;
-      else regNumber = 8;
-      return Operand(AddressModes::REGISTER_INDIRECT_OFFSET_SYMBOL, match[3], regNumber);
-    }
-    else {op = match[2]; return Operand(AddressModes::REGISTER_INDIRECT_OFFSET_SYMBOL, match[3], stoi(op));}
-  }
-
-  reg = ("^(\\d+|0x[0-9a-fA-F]+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::IMMEDIATE_LITERAL, match[1]);
-
-  reg = ("^(\\w+)$");
-  if (regex_search(operand, match, reg)) return Operand(AddressModes::IMMEDIATE_SYMBOL, match[1]);
-
-  return Operand();
+// word ( , word )* up to the end of the line
+bool parseWordList(Lexer& lexer, vector<string_view>& words) {
+  do {
+    const Token& token = lexer.peek();
+    if (token.kind != TokenKind::WORD) return false;
+    words.push_back(lexer.next().text);
+  } while (lexer.accept(','));
+  return lexer.atEnd();
 }
 
 unsigned char getAddressModeValue(AddressModes mode) {
@@ -350,7 +181,7 @@ void switchDataOperand(Operand op, Asembler* asem, unsigned char opCode, unsigne
   unsigned char addrMode = getAddressModeValue(op.mode);
   unsigned char regDescr;
   Symbol* symbol;
-  string currSec = string(SymbolTable::currentSection);
+  int currSec = asem->sectionIndexForGeneratedCode;
   switch (op.mode){
   case AddressModes::IMMEDIATE_LITERAL:
   case AddressModes::MEMORY_DIRECT_LITERAL:
@@ -372,7 +203,7 @@ void switchDataOperand(Operand op, Asembler* asem, unsigned char opCode, unsigne
 
     symbol = asem->symbolTable.getSymbolByKey(op.operand);
     if (symbol != nullptr) symbol->backpatch.push_back(SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD));
-    else asem->symbolTable.table.emplace(op.operand, new Symbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD)));
+    else asem->symbolTable.addSymbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD));
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0x00);
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0x00);
     asem->lc+=2;
@@ -387,7 +218,7 @@ void switchDataOperand(Operand op, Asembler* asem, unsigned char opCode, unsigne
 
     symbol = asem->symbolTable.getSymbolByKey(op.operand);
     if (symbol != nullptr) symbol->backpatch.push_back(SymbolUsage(asem->lc, currSec, TypeOfUse::PC_REL));
-    else asem->symbolTable.table.emplace(op.operand, new Symbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::PC_REL)));
+    else asem->symbolTable.addSymbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::PC_REL));
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0xFE);
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0xFF);
     asem->lc+=2;
@@ -423,7 +254,7 @@ void switchDataOperand(Operand op, Asembler* asem, unsigned char opCode, unsigne
 
     symbol = asem->symbolTable.getSymbolByKey(op.operand);
     if (symbol != nullptr) symbol->backpatch.push_back(SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD));
-    else asem->symbolTable.table.emplace(op.operand, new Symbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD)));
+    else asem->symbolTable.addSymbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD));
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0x00);
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0x00);
     asem->lc+=2;
@@ -436,8 +267,7 @@ void switchDataOperand(Operand op, Asembler* asem, unsigned char opCode, unsigne
 void switchAddressOperand(Operand op, Asembler* asem, unsigned char opCode) {
   int value;
   unsigned char addrMode = getAddressModeValueForJumpAddress(op.mode);
-  unsigned char regDescr;
-  string currSec = string(SymbolTable::currentSection);
+  int currSec = asem->sectionIndexForGeneratedCode;
   Symbol* symbol;
   switch (op.mode){
   case AddressModes::IMMEDIATE_LITERAL:
@@ -460,7 +290,7 @@ void switchAddressOperand(Operand op, Asembler* asem, unsigned char opCode) {
 
     symbol = asem->symbolTable.getSymbolByKey(op.operand);
     if (symbol != nullptr) symbol->backpatch.push_back(SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD));
-    else asem->symbolTable.table.emplace(op.operand, new Symbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD)));
+    else asem->symbolTable.addSymbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD));
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0x00);
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0x00);
     asem->lc+=2;
@@ -473,7 +303,7 @@ void switchAddressOperand(Operand op, Asembler* asem, unsigned char opCode) {
 
     symbol = asem->symbolTable.getSymbolByKey(op.operand);
     if (symbol != nullptr) symbol->backpatch.push_back(SymbolUsage(asem->lc, currSec, TypeOfUse::PC_REL));
-    else asem->symbolTable.table.emplace(op.operand, new Symbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::PC_REL)));
+    else asem->symbolTable.addSymbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::PC_REL));
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0xFE);
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0xFF);
     asem->lc+=2;
@@ -503,7 +333,7 @@ void switchAddressOperand(Operand op, Asembler* asem, unsigned char opCode) {
 
     symbol = asem->symbolTable.getSymbolByKey(op.operand);
     if (symbol != nullptr) symbol->backpatch.push_back(SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD));
-    else asem->symbolTable.table.emplace(op.operand, new Symbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD)));
+    else asem->symbolTable.addSymbol(op.operand, 0, false, false, -1, false, SymbolUsage(asem->lc, currSec, TypeOfUse::SYMBOL_WORD));
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0x00);
     asem->generatedCode[asem->sectionIndexForGeneratedCode].push_back(0x00);
     asem->lc+=2;
@@ -513,27 +343,26 @@ void switchAddressOperand(Operand op, Asembler* asem, unsigned char opCode) {
   }
 }
 
-int switchInstruction(Instructions instr, string line, Asembler* as) {
-  regex reg;
-  smatch match;
+int switchInstruction(Instructions instr, Lexer& lexer, Asembler* as) {
   unsigned char operationCode = instructionOperationCodes.at(instr);
-  unsigned char regDest;
-  unsigned char regDescr;
+  int regDest;
+  int regDescr;
   Operand op;
 
   switch (instr){
     case HALT:
     case IRET:
     case RET:
+      if (!lexer.atEnd()) throw SyntaxError(as->lineCnt);
       as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
       as->lc++;
       break;
     case INT:
-      reg = ("^\\s*int (r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDest = parseDestRegister(match);
+    case NOT:
+      regDest = parseRegister(lexer);
+      if (regDest < 0 || !lexer.atEnd()) throw SyntaxError(as->lineCnt);
       as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDest);
+      as->generatedCode[as->sectionIndexForGeneratedCode].push_back((regDest << 4) | 0xF);
       as->lc += 2;
       break;
     case CALL:
@@ -541,153 +370,44 @@ int switchInstruction(Instructions instr, string line, Asembler* as) {
     case JEQ:
     case JNE:
     case JGT:
-      reg = ("^\\s*(?:call|jmp|jeq|jne|jgt) ([ \\w$%\\[\\]\\+\\*]+)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      op = parseAddressOperand(trim(match[1]));
-      if (op.mode == AddressModes::INVALID) throw SyntaxError(as->lineCnt);
+      op = parseAddressOperand(lexer);
+      if (op.mode == AddressModes::INVALID || !lexer.atEnd()) throw SyntaxError(as->lineCnt);
       switchAddressOperand(op, as, operationCode);
       break;
     case PUSH:
-      reg = ("^\\s*push (r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseDestRegister(match);
-      regDescr &= 0xF0;
-      regDescr |= 0x06;
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(0x12); //addrMode
-      as->lc+=3;
-      break;
     case POP:
-      reg = ("^\\s*pop (r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseDestRegister(match);
-      regDescr &= 0xF0;
-      regDescr |= 0x06;
+      regDest = parseRegister(lexer);
+      if (regDest < 0 || !lexer.atEnd()) throw SyntaxError(as->lineCnt);
       as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(0x42); //addrMode
+      as->generatedCode[as->sectionIndexForGeneratedCode].push_back((regDest << 4) | 0x06);
+      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(instr == PUSH ? 0x12 : 0x42); //addrMode
       as->lc+=3;
       break;
     case XCHG:
-      reg = ("^\\s*xchg (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case ADD:
-      reg = ("^\\s*add (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case SUB:
-      reg = ("^\\s*sub (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case MUL:
-      reg = ("^\\s*mul (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case DIV:
-      reg = ("^\\s*div (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case CMP:
-      reg = ("^\\s*cmp (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
-    case NOT:
-      reg = ("^\\s*not (r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDest = parseDestRegister(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDest);
-      as->lc += 2;
-      break;
     case AND:
-      reg = ("^\\s*and (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case OR:
-      reg = ("^\\s*or (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case XOR:
-      reg = ("^\\s*xor (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case TEST:
-      reg = ("^\\s*test (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case SHL:
-      reg = ("^\\s*shl (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
-      as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
-      as->lc += 2;
-      break;
     case SHR:
-      reg = ("^\\s*shr (r([0-7])|pc|sp|psw)\\s*,\\s*(r([0-7])|pc|sp|psw)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDescr = parseRegisters(match);
+      regDescr = parseRegisters(lexer);
+      if (regDescr < 0 || !lexer.atEnd()) throw SyntaxError(as->lineCnt);
       as->generatedCode[as->sectionIndexForGeneratedCode].push_back(operationCode);
       as->generatedCode[as->sectionIndexForGeneratedCode].push_back(regDescr);
       as->lc += 2;
       break;
     case LDR:
-      reg = ("^\\s*ldr (r([0-7])|pc|sp|psw)\\s*,\\s*([\\w $%\\[\\]\\+\\*]+)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDest = parseDestRegister(match);
-      op = parseDataOperand(trim(match[3]));
-      if (op.mode == AddressModes::INVALID) throw SyntaxError(as->lineCnt);
-      switchDataOperand(op, as, operationCode, regDest);
-      break;
     case STR:
-      reg = ("^\\s*str (r([0-7])|pc|sp|psw)\\s*,\\s*([\\w $%\\[\\]\\+\\*]+)\\s*(?:#.*)?$");
-      if (!regex_search(line, match, reg)) throw SyntaxError(as->lineCnt);
-      regDest = parseDestRegister(match);
-      op = parseDataOperand(trim(match[3]));
-      if (op.mode == AddressModes::INVALID) throw SyntaxError(as->lineCnt);
-      switchDataOperand(op, as, operationCode, regDest);
+      regDest = parseRegister(lexer);
+      if (regDest < 0 || !lexer.accept(',')) throw SyntaxError(as->lineCnt);
+      op = parseDataOperand(lexer);
+      if (op.mode == AddressModes::INVALID || !lexer.atEnd()) throw SyntaxError(as->lineCnt);
+      switchDataOperand(op, as, operationCode, (regDest << 4) | 0xF);
       break;
     case ERROR:
       break;
@@ -714,143 +434,124 @@ int getSectionIndex(Asembler* as, string secName) {
 
 /* Assembler methods */
 void Asembler::assemble() {
-  ifstream ulaz(this->input);
-  ofstream izlaz(this->output);
+  SourceFile source(this->input);
+  ofstream izlaz(this->output, textOutput ? ios::out : ios::binary);
 
-  string line;
+  string_view line;
   int ret;
-  if (!ulaz.is_open()) throw UnknownFileError(this->input.c_str());
   if (!izlaz.is_open()) throw UnknownFileError(this->output.c_str());
-  
-  regex comment("^\\s*#.*\\s*$");
 
-  while (getline(ulaz, line)) { //assembly pass
-    if (line == "\n" || line.empty() || regex_search(line, comment) || line.find_first_not_of(' ') == string::npos) {
-      this->lineCnt++; 
+  while (source.nextLine(line)) { //assembly pass
+    Lexer lexer(line);
+    if (lexer.atEnd()) { // empty or comment only
+      this->lineCnt++;
       continue;
     }
 
-    ret = processLine(line);
+    ret = processLine(lexer);
     if (ret == static_cast<int>(Directives::END)) break;
     if (ret == 0) throw SyntaxError(this->lineCnt);
 
     this->lineCnt++;
   }
-  ulaz.close();
   ret = backpatchAndGenerateRealocationEntries();
   if (ret != 0) throw SyntaxError(this->lineCnt);
-  formOutput(izlaz);
+  if (textOutput) formOutput(izlaz);
+  else formBinaryOutput(izlaz);
   izlaz.close();
 }
 
-int Asembler::processLine(string line) {
-  regex reg;
-  smatch match;
-
-  reg = ("^\\s*(\\w*):\\s*(#.*)?$");
-  if (regex_search(line, match, reg)) return processLabelOnly(match[1]);
-
-  reg = ("^\\s*\\.");
-  if (regex_search(line, reg)) return processDirective(line);
-
-  reg = ("^\\s*.*:\\s*[a-z]{3,4}");
-  if (regex_search(line, reg)) return processInstructionWithLabel(line);
-
-  reg = ("^\\s*[a-z]{3,4}");
-  if (regex_search(line, reg)) return processInstruction(line);
-
-  return 0;
+int Asembler::processLine(Lexer& lexer) {
+  Token first = lexer.next();
+  if (first.is('.')) return processDirective(lexer);
+  if (first.kind != TokenKind::WORD) return 0;
+  if (!lexer.accept(':')) return processInstruction(first.text, lexer);
+  if (lexer.atEnd()) return processLabelOnly(string(first.text));
+  return processInstructionWithLabel(first.text, lexer);
 }
 
 int Asembler::processLabelOnly(string label) {
-  if (Symbol::currentSectionNumber == 0) throw NoSectionError(this->lineCnt);
+  if (symbolTable.currentSectionNumber == 0) throw NoSectionError(this->lineCnt);
 
   Symbol* symbol = symbolTable.getSymbolByKey(label);
   if (symbol == nullptr) {
-    symbolTable.table.emplace(label, new Symbol(label, lc, false, false, -1, true));
+    symbolTable.addSymbol(label, lc, false, false, -1, true);
   } else {
-    if (symbol->isExtern) throw DefiningExternSymbolError((symbol->name).c_str());
+    if (symbol->isExtern) throw DefiningExternSymbolError(symbol->name.data());
     symbol->value = lc;
-    symbol->sectionNumber = Symbol::currentSectionNumber;
+    symbol->sectionNumber = symbolTable.currentSectionNumber;
   }
 
   return 1;
 }
 
-int Asembler::processDirective(string line) {
-  regex reg;
-  smatch match;
+int Asembler::processDirective(Lexer& lexer) {
+  Token token = lexer.next();
+  vector<string_view> words;
   string literal;
-  string ascii;
 
-  reg = ("^\\s*\\.([a-z]{3,7})");
-  regex_search(line, match, reg);
-  Directives dir = enumerateDirective(match[1]);
-  if ((dir == WORD || dir == SKIP || dir == ASCII) && Symbol::currentSectionNumber == 0) 
+  const Keyword& keyword = lookupKeyword(token.text);
+  Directives dir = token.kind == TokenKind::WORD && keyword.kind == KeywordKind::DIRECTIVE ? Directives(keyword.value) : Directives::INVALID;
+  if ((dir == WORD || dir == SKIP || dir == ASCII) && symbolTable.currentSectionNumber == 0) 
     throw NoSectionError(this->lineCnt);
 
   switch (dir){
     case GLOBAL:
-      reg = ("^\\s*\\.global ((\\w*)(\\s*,\\s*\\w*)*)\\s*(#.*)?$");
-      if (regex_search(line, match, reg)) {
-        string symbolList = deleteSpaces(match[1]);
-        vector<string> symbols = commaSeparatedListToVector(symbolList);
-        for (size_t i = 0; i < symbols.size(); i++){
-          Symbol* symbol = symbolTable.getSymbolByKey(symbols[i]);
+      if (parseWordList(lexer, words)) {
+        for (size_t i = 0; i < words.size(); i++){
+          string name(words[i]);
+          Symbol* symbol = symbolTable.getSymbolByKey(name);
           if (symbol != nullptr) {
-            if (symbol->isExtern) throw GlobalExternCollision(symbol->name.c_str());
+            if (symbol->isExtern) throw GlobalExternCollision(symbol->name.data());
             symbol->isGlobal = true;
           } else {
-            symbolTable.table.emplace(symbols[i], new Symbol(symbols[i], 0, true, false, -1, false));
+            symbolTable.addSymbol(name, 0, true, false, -1, false);
           }
         }
       }
       else dir = INVALID;
       break;
     case EXTERN:
-      reg = ("^\\s*\\.extern ((\\w*)(\\s*,\\s*\\w*)*)\\s*(#.*)?$");
-      if (regex_search(line, match, reg)) {
-        string symbolList = deleteSpaces(match[1]);
-        vector<string> symbols = commaSeparatedListToVector(symbolList);
-        for (size_t i = 0; i < symbols.size(); i++){
-          Symbol* symbol = symbolTable.getSymbolByKey(symbols[i]);
+      if (parseWordList(lexer, words)) {
+        for (size_t i = 0; i < words.size(); i++){
+          string name(words[i]);
+          Symbol* symbol = symbolTable.getSymbolByKey(name);
           if (symbol != nullptr) {
-            if (symbol->isGlobal) throw ExternGlobalCollision((symbol->name).c_str());
-            if (symbol->sectionNumber != 0) throw ImportingDefinedSymbolError((symbol->name).c_str());
+            if (symbol->isGlobal) throw ExternGlobalCollision(symbol->name.data());
+            if (symbol->sectionNumber != 0) throw ImportingDefinedSymbolError(symbol->name.data());
             symbol->isExtern = true;
           } else {
-            symbolTable.table.emplace(symbols[i], new Symbol(symbols[i], 0, false, true, -1, false));
+            symbolTable.addSymbol(name, 0, false, true, -1, false);
           }
         }
       }
       else dir = INVALID;
       break;
     case SECTION:
-      reg = ("^\\s*\\.section (\\w*)\\s*(#.*)?$");
-      if (regex_search(line, match, reg)) {
-        if (SymbolTable::currentSection != "UND") {
-          symbolTable.updateSectionSize(SymbolTable::currentSection, lc);
+      token = lexer.next();
+      if (token.kind == TokenKind::WORD && lexer.atEnd()) {
+        string name(token.text);
+        if (symbolTable.currentSection != "UND") {
+          symbolTable.updateSectionSize(symbolTable.currentSection, lc);
           sectionIndexForGeneratedCode++;
         }
 
-        if (symbolTable.getSymbolByKey(match[1]) != nullptr) throw SectionDefinedError(this->lineCnt);
-        symbolTable.table.emplace(match[1], new Symbol(match[1], 0, true, true, 0, true));
-        SymbolTable::currentSection = match[1];
+        if (symbolTable.getSymbolByKey(name) != nullptr) throw SectionDefinedError(this->lineCnt);
+        symbolTable.addSymbol(name, 0, true, true, 0, true);
+        symbolTable.currentSection = name;
         
-        sections.push_back(match[1]);
+        sections.push_back(name);
         generatedCode.push_back(vector<unsigned char>(0,0));
         lc = 0;
       }
       else dir = INVALID;
       break;
     case WORD:
-      reg = ("^\\s*\\.word ((?:\\d+|0x[\\da-fA-F]+|\\w+)(?:\\s*,\\s*(?:\\d+|0x[\\da-fA-F]+|\\w)+)*)\\s*(?:#.*)?$");
-      if (regex_search(line, match, reg)) {
-        string list = deleteSpaces(match[1]);
-        vector<string> init = commaSeparatedListToVector(list);
+      if (parseWordList(lexer, words)) {
         bool stoiSuccessful;
         unsigned int literalValue;
-        for(string x: init) {
+        for(string_view word: words) {
+          string x(word);
           stoiSuccessful = true;
           try {
             literalValue = stoi(x);
@@ -867,9 +568,9 @@ int Asembler::processDirective(string line) {
           } else {
             Symbol* symbol = symbolTable.getSymbolByKey(x);
             if (symbol == nullptr) {
-              symbolTable.table.emplace(x, new Symbol(x, 0, false, false, -1, false, SymbolUsage(lc, SymbolTable::currentSection, TypeOfUse::SYMBOL_WORD)));
+              symbolTable.addSymbol(x, 0, false, false, -1, false, SymbolUsage(lc, sectionIndexForGeneratedCode, TypeOfUse::SYMBOL_WORD));
             } else {
-              symbol->backpatch.push_back(SymbolUsage(lc, SymbolTable::currentSection, TypeOfUse::SYMBOL_WORD));
+              symbol->backpatch.push_back(SymbolUsage(lc, sectionIndexForGeneratedCode, TypeOfUse::SYMBOL_WORD));
             }
             generatedCode[sectionIndexForGeneratedCode].push_back(0x00);
             generatedCode[sectionIndexForGeneratedCode].push_back(0x00);
@@ -880,22 +581,21 @@ int Asembler::processDirective(string line) {
       else dir = INVALID;
       break;
     case ASCII:
-      reg = ("^\\s*\\.ascii \"(.+)\"\\s*(?:#.*)?$");
-      if (regex_search(line, match, reg)) {
-        ascii = match[1];
-        for (size_t i = 0; i < ascii.length(); i++){
-          this->generatedCode[sectionIndexForGeneratedCode].push_back((unsigned char)ascii[i]);
+      token = lexer.next();
+      if (token.kind == TokenKind::STRING && !token.text.empty() && lexer.atEnd()) {
+        for (size_t i = 0; i < token.text.length(); i++){
+          this->generatedCode[sectionIndexForGeneratedCode].push_back((unsigned char)token.text[i]);
         }
-        lc += ascii.length();
+        lc += token.text.length();
       }
       else dir = INVALID;
       break;
     case SKIP:
-      reg = ("^\\s*\\.skip (\\d*)\\s*(?:#.*)?$");
-      if (regex_search(line, match, reg)) {
-        literal = match[1];
+      token = lexer.next();
+      if (token.kind == TokenKind::WORD && token.text.find_first_not_of("0123456789") == string_view::npos && lexer.atEnd()) {
+        literal = token.text;
         int skipCnt = stoi(literal);
-        for (size_t i = 0; i < skipCnt; i++){
+        for (int i = 0; i < skipCnt; i++){
           this->generatedCode[sectionIndexForGeneratedCode].push_back(0x00);
         }
         lc+=skipCnt;
@@ -903,7 +603,8 @@ int Asembler::processDirective(string line) {
       else dir = INVALID;
       break;
     case END:
-      symbolTable.updateSectionSize(SymbolTable::currentSection, lc);
+      if (lexer.atEnd()) symbolTable.updateSectionSize(symbolTable.currentSection, lc);
+      else dir = INVALID;
       break;
     case INVALID:
       break;
@@ -913,64 +614,55 @@ int Asembler::processDirective(string line) {
   return int(dir);
 }
 
-int Asembler::processInstructionWithLabel(string line) {
-  if (Symbol::currentSectionNumber == 0) throw NoSectionError(this->lineCnt);
-  regex reg;
-  smatch match;
+int Asembler::processInstructionWithLabel(string_view label, Lexer& lexer) {
+  if (symbolTable.currentSectionNumber == 0) throw NoSectionError(this->lineCnt);
+  string name(label);
 
-  reg = ("^\\s*(.*):");
-  regex_search(line, match, reg);
-
-  Symbol* symbol = symbolTable.getSymbolByKey(match[1]);
+  Symbol* symbol = symbolTable.getSymbolByKey(name);
   if (symbol == nullptr) {
-    symbolTable.table.emplace(match[1], new Symbol(match[1], lc, false, false, -1, true));
+    symbolTable.addSymbol(name, lc, false, false, -1, true);
   } else {
-    if (symbol->isExtern) throw ImportingDefinedSymbolError((symbol->name).c_str());
+    if (symbol->isExtern) throw ImportingDefinedSymbolError(symbol->name.data());
     symbol->value = lc;
-    symbol->sectionNumber = Symbol::currentSectionNumber;
+    symbol->sectionNumber = symbolTable.currentSectionNumber;
   }
 
-  line = regex_replace(line, regex("^\\s*.*:"), string(""));
-  reg = ("^\\s*([a-z]{3,4})");
-  regex_search(line, match, reg);
-  Instructions instr = enumerateInstruction(match[1]);
-
-  return switchInstruction(instr, line, this);
+  Token mnemonic = lexer.next();
+  if (mnemonic.kind != TokenKind::WORD) return 0;
+  return processInstruction(mnemonic.text, lexer);
 }
 
-int Asembler::processInstruction(string line) {
-  if (Symbol::currentSectionNumber == 0) throw NoSectionError(this->lineCnt);
-  regex reg;
-  smatch match;
+int Asembler::processInstruction(string_view mnemonic, Lexer& lexer) {
+  if (symbolTable.currentSectionNumber == 0) throw NoSectionError(this->lineCnt);
 
-  reg = ("^\\s*([a-z]{3,4})");
-  regex_search(line, match, reg);
-  Instructions instr = enumerateInstruction(match[1]);
+  const Keyword& keyword = lookupKeyword(mnemonic);
+  if (keyword.kind != KeywordKind::MNEMONIC) return 0;
+  Instructions instr = Instructions(keyword.value);
 
-  return switchInstruction(instr, line, this);
+  return switchInstruction(instr, lexer, this);
 }
 
 int Asembler::backpatchAndGenerateRealocationEntries() {
   int secIndex, offset, value;
   string symbolTableRef;
-  for(const auto& x: symbolTable.table) {
-    if (x.second->isSection()) continue;
-    value = x.second->value;
-    for (const auto& usage: x.second->backpatch) {
+  for(Symbol* symbol: symbolTable.sortedByName()) { // name order keeps the relocation entries in a stable order
+    if (symbol->isSection()) continue;
+    value = symbol->value;
+    for (const auto& usage: symbol->backpatch) {
       offset = usage.offset;
-      if (!x.second->isGlobal && !x.second->isExtern) {
-        secIndex = getSectionIndex(this, usage.sectionName);
+      secIndex = usage.section;
+      if (!symbol->isGlobal && !symbol->isExtern) {
         int valueFromCode = (generatedCode[secIndex][offset + 1] << 8) | generatedCode[secIndex][offset];
         valueFromCode += value;
         generatedCode[secIndex][offset++] = valueFromCode & 0xFF;
         generatedCode[secIndex][offset] = ((valueFromCode & 0xFF00)>>8);
-        symbolTableRef = symbolTable.getSymbolByNumber(x.second->sectionNumber)->name;
-      } else symbolTableRef = x.second->name;
+        symbolTableRef = symbolTable.getSymbolByNumber(symbol->sectionNumber)->name;
+      } else symbolTableRef = symbol->name;
       //rel entry
       switch (usage.typeOfUse){
         case TypeOfUse::SYMBOL_WORD:
         case TypeOfUse::PC_REL:
-          relocationTable.table.emplace(usage.sectionName, new RelocationEntry(usage.typeOfUse, usage.offset, symbolTableRef));
+          relocationTable.table.emplace(sections[secIndex], new RelocationEntry(usage.typeOfUse, usage.offset, symbolTableRef));
           break;
         case TypeOfUse::UNKNOWN:
           return -1;
@@ -984,33 +676,112 @@ int Asembler::backpatchAndGenerateRealocationEntries() {
 }
 
 void Asembler::formOutput(ofstream& output) {
-  unsigned char byte;
+  string code;
   output << symbolTable << hex << uppercase;
 
   for (int i = 0; i < sectionIndexForGeneratedCode + 1; i++){
     output << "new section\n" << sections[i] << "\n" << hex;
-    for (int j = 0; j < generatedCode[i].size(); j++){
-      byte = generatedCode[i][j];
-      if (byte < 16 && byte >= 0) output << 0 << (int)byte << ':';
-      else output << (int)byte << ':';
-    }
-    output << '\n';
+    code.resize(generatedCode[i].size() * 3);
+    encodeHex(generatedCode[i].data(), generatedCode[i].size(), ':', &code[0]);
+    output << code << '\n';
     relocationTable.printSectionRelocationEntries(output, sections[i]);
     output << "end section\n";
   }
   output << "end file\n";
 }
 
+// same contents as formOutput, relocations refer to their symbol by its position in the name ordered table
+void Asembler::formBinaryOutput(ofstream& output) {
+  vector<Symbol*> sorted = symbolTable.sortedByName();
+  vector<uint32_t> symbolIndex(sorted.size()); // position in the table -> index in the file
+  for (size_t i = 0; i < sorted.size(); i++) symbolIndex[sorted[i] - &*symbolTable.begin()] = i;
+
+  string strings;
+  vector<ObjectSymbol> symbols;
+  for (Symbol* symbol: sorted) {
+    uint32_t flags = (symbol->isGlobal ? OBJECT_SYMBOL_GLOBAL : 0) | (symbol->isExtern ? OBJECT_SYMBOL_EXTERN : 0);
+    symbols.push_back(ObjectSymbol{(uint32_t)strings.size(), symbol->number, symbol->sectionNumber, symbol->value, symbol->size, flags});
+    strings += symbol->name;
+    strings += '\0';
+  }
+  vector<ObjectSection> objectSections;
+  vector<const unsigned char*> bytes;
+  vector<ObjectRelocation> relocations;
+  for (size_t i = 0; i < sections.size(); i++) {
+    objectSections.push_back(ObjectSection{(uint32_t)strings.size(), 0, (uint32_t)generatedCode[i].size(), (uint32_t)relocations.size(), 0});
+    bytes.push_back(generatedCode[i].data());
+    strings += sections[i];
+    strings += '\0';
+    auto range = relocationTable.table.equal_range(sections[i]);
+    for (auto it = range.first; it != range.second; ++it) {
+      Symbol* symbol = symbolTable.getSymbolByKey(it->second->symbolTableReference);
+      uint32_t index = symbolIndex[symbol - &*symbolTable.begin()];
+      relocations.push_back(ObjectRelocation{(uint32_t)it->second->location, index, (uint32_t)it->second->realocationType});
+      objectSections.back().relocationCount++;
+    }
+  }
+
+  vector<unsigned char> object = writeObject(symbols, objectSections, bytes, relocations, strings);
+  output.write((const char*)object.data(), object.size());
+}
+
+// a.s becomes a.o, names without the extension get it appended
+static string objectName(const string& input) {
+  size_t length = input.size();
+  if (length > 2 && input.compare(length - 2, 2, ".s") == 0) return input.substr(0, length - 2) + ".o";
+  return input + ".o";
+}
+
+// every unit gets its own Asembler, the pool threads take the next unassembled one until none are left,
+// errors are reported in input order once all are done
+static int assembleUnits(const vector<string>& inputs, int jobs, bool text) {
+  vector<string> errors(inputs.size());
+  atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < inputs.size(); i = next++) {
+      try {
+        Asembler asembler(inputs[i], objectName(inputs[i]), text);
+        asembler.assemble();
+      } catch (const exception& e) {
+        errors[i] = e.what();
+      }
+    }
+  };
+  vector<thread> pool;
+  for (size_t i = 1; i < (size_t)jobs && i < inputs.size(); i++) pool.emplace_back(worker);
+  worker();
+  for (thread& t: pool) t.join();
+
+  int failed = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (errors[i].empty()) continue;
+    cout << inputs[i] << ": " << errors[i] << '\n';
+    failed = 1;
+  }
+  return failed;
+}
+
 int main(int argc, char* argv[]) {
   try {
     const char* op = "-o";
+    const char* jobsOption = "-j";
+    const char* textOption = "-text";
     Asembler* asembler = nullptr;
 
+    bool text = argc > 1 && strcmp(argv[1], textOption) == 0; // object files in the line based format
+    if (text) {
+      argv++;
+      argc--;
+    }
     if (argc < 2) throw InvalidCmdArgs();
+    if (strcmp(argv[1], jobsOption) == 0) { // -j N a.s b.s ..., one object file per unit
+      if (argc < 4 || atoi(argv[2]) < 1) throw InvalidCmdArgs();
+      return assembleUnits(vector<string>(argv + 3, argv + argc), atoi(argv[2]), text);
+    }
     if (argc == 2) {
-      asembler = new Asembler(argv[1]);
+      asembler = new Asembler(argv[1], "asemblerOutput.o", text);
     } else if (strcmp(argv[1], op) == 0) {
-      asembler = new Asembler(argv[3], argv[2]);
+      asembler = new Asembler(argv[3], argv[2], text);
     } else throw InvalidCmdArgs();
 
     asembler->assemble();
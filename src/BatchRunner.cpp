@@ -0,0 +1,156 @@
+#include "../inc/BatchRunner.hpp"
+#include <thread>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+
+// splits a manifest line on white space, double quotes keep white space inside an argument
+static vector<string> splitArguments(const string& line) {
+  vector<string> arguments;
+  string current;
+  bool quoted = false, any = false;
+  for (char c: line) {
+    if (c == '"') {
+      quoted = !quoted;
+      any = true;
+    }
+    else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+      if (any) arguments.push_back(current);
+      current.clear();
+      any = false;
+    }
+    else {
+      current += c;
+      any = true;
+    }
+  }
+  if (any) arguments.push_back(current);
+  return arguments;
+}
+
+// every line of the manifest is "<image> [options]", empty lines and lines starting with # are skipped
+BatchRunner::BatchRunner(const string& manifest, const EmulatorOptions& defaults, int threads) {
+  ifstream in(manifest);
+  if (!in.is_open()) throw UnknownFileError(manifest.c_str());
+  string line;
+  while (getline(in, line)) {
+    vector<string> arguments = splitArguments(line);
+    if (arguments.empty() || arguments[0][0] == '#') continue;
+    BatchJob job;
+    job.options = defaults;
+    job.options.input = arguments[0];
+    for (size_t i = 1; i < arguments.size(); i++) {
+      if (!job.options.parse(arguments[i])) throw InvalidCmdArgs();
+    }
+    job.options.headless = true;
+    jobs.push_back(job);
+  }
+  workers = threads > 0 ? threads : thread::hardware_concurrency();
+  if (workers <= 0) workers = 1;
+}
+
+void BatchRunner::run() {
+  vector<WorkQueue> queues(workers);
+  for (size_t i = 0; i < jobs.size(); i++) queues[i % workers].jobs.push_back(i);
+
+  vector<thread> threads;
+  for (int i = 1; i < workers; i++) threads.push_back(thread(&BatchRunner::worker, this, ref(queues), i));
+  worker(queues, 0);
+  for (thread& t: threads) t.join();
+}
+
+void BatchRunner::worker(vector<WorkQueue>& queues, int id) {
+  size_t job;
+  while (take(queues, id, job)) runJob(jobs[job]);
+}
+
+// nothing is added while the batch runs, so all queues being empty means the work is done
+bool BatchRunner::take(vector<WorkQueue>& queues, int id, size_t& job) {
+  {
+    lock_guard<mutex> guard(queues[id].lock);
+    if (!queues[id].jobs.empty()) {
+      job = queues[id].jobs.back();
+      queues[id].jobs.pop_back();
+      return true;
+    }
+  }
+  for (int i = 1; i < workers; i++) {
+    WorkQueue& victim = queues[(id + i) % workers];
+    lock_guard<mutex> guard(victim.lock);
+    if (!victim.jobs.empty()) {
+      job = victim.jobs.front();
+      victim.jobs.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+// the processor state is reported however a loaded image stopped, a fault or a limit is when it is needed most
+void BatchRunner::runJob(BatchJob& job) {
+  unique_ptr<Emulator> emulator;
+  bool loaded = false;
+  try {
+    emulator.reset(new Emulator(job.options.input, job.options.engine));
+    emulator->configure(job.options);
+    emulator->captureOutput(&job.output);
+    emulator->loadMemory();
+    loaded = true;
+    emulator->execute();
+    job.status = "halt";
+  }
+  catch(const EmulationLimitReached& e) {
+    job.status = "limit";
+    job.message = e.what();
+  }
+  catch(const exception& e) {
+    job.status = "fault";
+    job.message = e.what();
+  }
+  if (emulator == nullptr) return;
+  job.instructions = emulator->executedInstructions();
+  if (loaded) {
+    stringstream state;
+    emulator->writeOutput(state, job.status == "halt");
+    job.state = state.str();
+  }
+}
+
+static string escape(const string& text) {
+  stringstream sstr;
+  for (unsigned char c: text) {
+    if (c == '\n') sstr << "\\n";
+    else if (c == '\\') sstr << "\\\\";
+    else if (c == '"') sstr << "\\\"";
+    else if (c < 0x20 || c >= 0x7F) sstr << "\\x" << hex << setfill('0') << setw(2) << (int)c << dec;
+    else sstr << c;
+  }
+  return sstr.str();
+}
+
+// jobs are reported in manifest order, whichever worker ran them
+void BatchRunner::writeReport(ostream& out) const {
+  int counts[3] = {0};
+  for (const BatchJob& job: jobs) {
+    out << "=== " << job.options.input << '\n';
+    out << "status: " << job.status << '\n';
+    if (!job.message.empty()) out << "reason: " << job.message << '\n';
+    out << "instructions: " << dec << job.instructions << '\n';
+    out << "output: \"" << escape(job.output) << "\"\n";
+    out << job.state;
+    if (job.status == "halt") counts[0]++;
+    else if (job.status == "fault") counts[1]++;
+    else counts[2]++;
+  }
+  out << "=== " << dec << jobs.size() << " images: " << counts[0] << " halted, " << counts[1] << " faulted, " << counts[2] << " stopped by a limit\n";
+}
+
+// a fault outranks a limit, so a faulting image is not hidden behind one that ran out of time
+int BatchRunner::status() const {
+  int result = 0;
+  for (const BatchJob& job: jobs) {
+    if (job.status == "fault") return 1;
+    if (job.status == "limit") result = 2;
+  }
+  return result;
+}
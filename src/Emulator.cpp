@@ -1,155 +1,792 @@
 #include "../inc/Emulator.hpp"
+#include "../inc/BatchRunner.hpp"
+#include "../inc/HexCodec.hpp"
 #include <fstream>
 #include <sstream>
 #include <unordered_map>
 #include <iomanip>
+#include <algorithm>
+#include <memory>
 
-int getch() {
-  unsigned char c;
-  if (read(STDIN_FILENO, &c, sizeof(char)) > 0) return c;
-  return 0;
+Emulator::Emulator(string i, Engines e) : psw(0), flagOperation(FLAGS_MATERIALIZED), flagResult(0), flagDestination(0), flagSource(0), unusedRegister(0), input(i), engine(e), jit(nullptr), maxAddress(0), terminalBreak(false), instructionCount(0), nextEvent(EventScheduler::NEVER), scriptPosition(0), instructionLimit(0), timeLimit(0), outputFile(nullptr) {
+  registerDevice(term_out, term_out + 1, &Emulator::terminalWrite);
+  registerDevice(tim_cfg, tim_cfg + 1, &Emulator::timerWrite);
 }
 
-Emulator::Emulator(string i) : input(i), maxAddress(0), psw(0), interruptRequests(0), terminalBreak(false) {}
+// value of "-option=value" arguments
+static bool optionValue(const char* argument, const char* option, string& value) {
+  if (strncmp(option, argument, strlen(option)) != 0) return false;
+  value = argument + strlen(option);
+  return true;
+}
+
+static unsigned long long numberValue(const string& value) {
+  if (value.empty() || value.find_first_not_of("0123456789") != string::npos) throw InvalidCmdArgs();
+  return stoull(value);
+}
+
+// "\n", "\r", "\t" and "\\" in scripted input
+static string unescape(const string& text) {
+  string result;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '\\' && i + 1 < text.size()) {
+      char c = text[++i];
+      if (c == 'n') result += '\n';
+      else if (c == 'r') result += '\r';
+      else if (c == 't') result += '\t';
+      else result += c;
+    }
+    else result += text[i];
+  }
+  return result;
+}
+
+static string readFile(const string& file) {
+  ifstream in(file, ios::binary);
+  if (!in.is_open()) throw UnknownFileError(file.c_str());
+  stringstream sstr;
+  sstr << in.rdbuf();
+  return sstr.str();
+}
+
+bool EmulatorOptions::parse(const string& argument) {
+  const char* arg = argument.c_str();
+  string value;
+  if (optionValue(arg, "-engine=", value)) {
+    if (value == "reference") engine = Engines::REFERENCE;
+    else if (value == "threaded") engine = Engines::THREADED;
+    else if (value == "jit") engine = Engines::JIT;
+    else throw InvalidCmdArgs();
+  }
+  else if (optionValue(arg, "-flush=", value)) {
+    // -flush=newline, -flush=halt or -flush=<microseconds>
+    if (value == "newline") flushPolicy = Terminal::FLUSH_ON_NEWLINE;
+    else if (value == "halt") flushPolicy = Terminal::FLUSH_ON_HALT;
+    else {
+      flushPolicy = Terminal::FLUSH_EVERY_INTERVAL;
+      flushInterval = numberValue(value);
+    }
+  }
+  else if (argument == "-stats") statistics = true;
+  else if (argument == "-headless") headless = true;
+  else if (optionValue(arg, "-input=", value)) {
+    inputText += readFile(value);
+    headless = true;
+  }
+  else if (optionValue(arg, "-input-string=", value)) {
+    inputText += unescape(value);
+    headless = true;
+  }
+  else if (optionValue(arg, "-input-schedule=", value)) {
+    inputSchedule = value;
+    headless = true;
+  }
+  else if (optionValue(arg, "-input-interval=", value)) inputInterval = numberValue(value);
+  else if (optionValue(arg, "-output=", value)) output = value;
+  else if (optionValue(arg, "-max-instructions=", value)) instructionLimit = numberValue(value);
+  else if (optionValue(arg, "-time-limit=", value)) timeLimit = numberValue(value);
+  else return false;
+  return true;
+}
+
+Emulator::~Emulator() {
+  if (jit != nullptr) delete jit;
+  terminal.stop();
+  terminal.flush();
+  if (outputFile != nullptr) fclose(outputFile);
+}
 
 void Emulator::loadMemory() {
-  ifstream ulaz(input);
-  string line;
-  if (!ulaz.is_open()) throw UnknownFileError(input.c_str());
+  if (loadImage()) return;
+  string text = readFile(input);
 
+  // "AAAA: XX XX .. XX" lines, a line always accounts for eight bytes of the address space
   int i = 0;
-  while(getline(ulaz, line)) {
-    stringstream sstr(line);
-    string data;
-    int start;
-    getline(sstr, data, ':'); 
-    start = stoi(data, nullptr, 16);
-    getline(sstr, data, ' ');
-    for(i = start; i < start + 8; i++) {
-      try{
-        getline(sstr, data, ' '); 
-        memory[i] = (unsigned char)stoi(data, nullptr, 16); 
-      } catch (const exception& e) {}
+  size_t position = 0;
+  while (position < text.size()) {
+    size_t end = text.find('\n', position);
+    if (end == string::npos) end = text.size();
+    size_t last = end;
+    while (last > position && (text[last - 1] == '\r' || text[last - 1] == ' ')) last--;
+    size_t colon = text.find(':', position);
+    if (last > position) {
+      if (colon >= last || colon == position || colon - position > 4) throw InvalidHexError();
+      int start = 0;
+      for (size_t j = position; j < colon; j++) {
+        int digit = isdigit(text[j]) ? text[j] - '0' : isxdigit(text[j]) ? (toupper(text[j]) - 'A' + 10) : -1;
+        if (digit < 0) throw InvalidHexError();
+        start = start * 16 + digit;
+      }
+      size_t data = colon + 1;
+      while (data < last && text[data] == ' ') data++;
+      if (start + 8 > 65536 || decodeHex(text.data() + data, last - data, ' ', memory + start, 8) < 0) throw InvalidHexError();
+      i = start + 8;
     }
+    position = end + 1;
   }
   maxAddress = i;
-  ulaz.close();
   r[7] = getMemoryValue(0);
 }
 
-void Emulator::execute() {unsigned char ch; int terminalOut;
+// binary images are mapped and their segments copied in place, false if the input is not one
+bool Emulator::loadImage() {
+  int descriptor = open(input.c_str(), O_RDONLY);
+  if (descriptor < 0) throw UnknownFileError(input.c_str());
+  struct stat status;
+  if (fstat(descriptor, &status) != 0 || status.st_size < IMAGE_HEADER_SIZE) {
+    close(descriptor);
+    return false;
+  }
+  size_t size = status.st_size;
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  close(descriptor);
+  if (mapping == MAP_FAILED) return false;
+  const unsigned char* image = (const unsigned char*)mapping;
+  if (memcmp(image, IMAGE_MAGIC, 4) != 0) {
+    munmap(mapping, size);
+    return false;
+  }
+
+  bool valid = readImage16(image + 4) == IMAGE_VERSION;
+  int segmentCount = readImage16(image + 8);
+  uint32_t segmentTable = readImage32(image + 16);
+  int highestAddress = -1;
+  if (valid && (uint64_t)segmentTable + (uint64_t)segmentCount * IMAGE_SEGMENT_SIZE > size) valid = false;
+  for (int i = 0; valid && i < segmentCount; i++) {
+    const unsigned char* segment = image + segmentTable + i * IMAGE_SEGMENT_SIZE;
+    uint32_t address = readImage32(segment), length = readImage32(segment + 4), offset = readImage32(segment + 8);
+    if ((uint64_t)address + length > 65536 || (uint64_t)offset + length > size) {
+      valid = false;
+      break;
+    }
+    memcpy(memory + address, image + offset, length);
+    if (length != 0 && (int)(address + length - 1) > highestAddress) highestAddress = address + length - 1;
+  }
+  int entry = readImage16(image + 6);
+  munmap(mapping, size);
+  if (!valid) throw InvalidImageError();
+
+  maxAddress = highestAddress < 0 ? 0 : (highestAddress & ~7) + 8; // same as the end of the last line of a hex dump
+  r[7] = entry;
+  return true;
+}
+
+void Emulator::execute() {
+  scheduleTimer(instructionCount); // the timer runs from reset with the period in tim_cfg
+  scheduleInput();
+  if (instructionLimit != 0) scheduler.schedule(DEVICE_LIMIT, instructionLimit);
+  if (timeLimit != 0) scheduler.schedule(DEVICE_WATCHDOG, instructionCount + WATCHDOG_INTERVAL);
+  if (terminal.needsFlushTicks()) scheduleFlush();
+  nextEvent = scheduler.nextDue();
+  startTime = chrono::steady_clock::now();
+  terminal.start();
+  try {
+    if (engine == Engines::THREADED) executeThreaded();
+    else if (engine == Engines::JIT) executeJit();
+    else executeReference();
+  } catch (const exception& e) {
+    terminal.stop();
+    terminal.flush(); // output produced before the fault comes before the error message
+    throw;
+  }
+  terminal.stop();
+  terminal.flush();
+}
+
+/* The terminal does not touch stdin in headless runs, input only comes from scriptInput. Without the reader thread
+ * the cpu loop keeps the time of the interval flush policy, in virtual time (see scheduleFlush), so the terminal or
+ * the -output file gets the output every interval of executed instructions as well as when the run ends, however
+ * it ends. The newline and halt policies behave the same as in interactive runs. */
+void Emulator::configure(const EmulatorOptions& options) {
+  terminal.configure(options.flushPolicy, options.flushInterval);
+  instructionLimit = options.instructionLimit;
+  timeLimit = options.timeLimit;
+  if (!options.output.empty()) {
+    outputFile = fopen(options.output.c_str(), "w");
+    if (outputFile == nullptr) throw UnknownFileError(options.output.c_str());
+    terminal.setOutput(outputFile);
+  }
+  if (!options.headless) return;
+  terminal.setInteractive(false);
+  if (!options.inputText.empty()) scriptInput(options.inputInterval, options.inputText, options.inputInterval);
+  if (!options.inputSchedule.empty()) {
+    stringstream schedule(readFile(options.inputSchedule));
+    string line;
+    while (getline(schedule, line)) {
+      size_t space = line.find(' ');
+      if (line.empty()) continue;
+      if (space == string::npos) throw InvalidCmdArgs();
+      scriptInput(numberValue(line.substr(0, space)), unescape(line.substr(space + 1)), options.inputInterval);
+    }
+  }
+}
+
+// characters of text reach term_in interval instructions apart, the first one at instruction at
+void Emulator::scriptInput(unsigned long long at, const string& text, int interval) {
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] != 0) script.push_back(ScriptedInput(at + i * interval, text[i]));
+  }
+  stable_sort(script.begin(), script.end(), [](const ScriptedInput& a, const ScriptedInput& b) {return a.at < b.at;});
+}
+
+void Emulator::executeReference() {
   while (true) {
-    unsigned char opCode = memory[r[7]];
-    incPC();
-    if (opCode == 0x00) break; //halt instruction
-    switch (opCode) {
-      case 0x10:
-        instructionINT();
-        break;
-      case 0x20:
-        instructionIRET();
-        break;
-      case 0x30:
-        instructionCALL();
-        break;
-      case 0x40:
-        instructionRET();
-        break;
-      case 0x50:
-        instructionJMP();
-        break;
-      case 0x51:
-        instructionJEQ();
-        break;
-      case 0x52:
-        instructionJNE();
-        break;
-      case 0x53:
-        instructionJGT();
-        break;
-      case 0x60:
-        instructionXCHG();
-        break;
-      case 0x70:
-        instructionADD();
-        break;
-      case 0x71:
-        instructionSUB();
-        break;
-      case 0x72:
-        instructionMUL();
-        break;
-      case 0x73:
-        instructionDIV();
-        break;
-      case 0x74:
-        instructionCMP();
-        break;
-      case 0x80:
-        instructionNOT();
-        break;
-      case 0x81:
-        instructionAND();
-        break;
-      case 0x82:
-        instructionOR();
-        break;
-      case 0x83:
-        instructionXOR();
-        break;
-      case 0x84:
-        instructionTEST();
+    int pc = r[7] & 0xFFFF;
+    DecodedInstruction& instr = decodeCache[pc].valid ? decodeCache[pc] : decode(pc);
+    if (pc + instr.length > 0xFFFF) throw PCOutOfBoundsError();
+    r[7] = pc + instr.length;
+    if (instr.opCode == 0x00) break; //halt instruction
+    (this->*instr.handler)(instr);
+    afterInstruction();
+  }
+}
+
+#if defined(__GNUC__)
+// every handler ends with its own copy of the dispatch, so each one gets its own indirect branch
+#define DISPATCH() \
+  pc = r[7] & 0xFFFF; \
+  instr = decodeCache[pc].valid ? &decodeCache[pc] : &decode(pc); \
+  if (pc + instr->length > 0xFFFF) throw PCOutOfBoundsError(); \
+  r[7] = pc + instr->length; \
+  goto *handlers[instr->threadedHandler]
+
+#define NEXT() \
+  afterInstruction(); \
+  DISPATCH()
+
+void Emulator::executeThreaded() {
+  static void* const handlers[] = {
+    &&halt, &&int_, &&iret, &&ret,
+    &&xchg, &&add, &&sub, &&mul, &&div, &&cmp,
+    &&not_, &&and_, &&or_, &&xor_, &&test, &&shl, &&shr,
+    &&call_immediate, &&call_register_direct, &&call_register_indirect, &&call_register_indirect_offset, &&call_memory, &&call_register_direct_addition,
+    &&jmp_immediate, &&jmp_register_direct, &&jmp_register_indirect, &&jmp_register_indirect_offset, &&jmp_memory, &&jmp_register_direct_addition,
+    &&jeq_immediate, &&jeq_register_direct, &&jeq_register_indirect, &&jeq_register_indirect_offset, &&jeq_memory, &&jeq_register_direct_addition,
+    &&jne_immediate, &&jne_register_direct, &&jne_register_indirect, &&jne_register_indirect_offset, &&jne_memory, &&jne_register_direct_addition,
+    &&jgt_immediate, &&jgt_register_direct, &&jgt_register_indirect, &&jgt_register_indirect_offset, &&jgt_memory, &&jgt_register_direct_addition,
+    &&ldr_immediate, &&ldr_register_direct, &&ldr_register_indirect, &&ldr_register_indirect_offset, &&ldr_memory, &&ldr_register_direct_addition,
+    &&reference, &&str_register_direct, &&str_register_indirect, &&str_register_indirect_offset, &&str_memory, &&str_register_direct_addition,
+    &&push, &&pop,
+    &&reference
+  };
+  int pc;
+  DecodedInstruction* instr;
+
+  DISPATCH();
+
+  halt:
+    return;
+  int_:
+    instructionINT(*instr);
+    NEXT();
+  iret:
+    flagOperation = FLAGS_MATERIALIZED;
+    pop(psw);
+    interrupts.setMask(psw);
+    pop(r[7]);
+    NEXT();
+  ret:
+    pop(r[7]);
+    NEXT();
+
+  xchg:
+    instructionXCHG(*instr);
+    NEXT();
+  add:
+    *instr->destination = (*instr->destination + *instr->source) & 0xFFFF;
+    NEXT();
+  sub:
+    *instr->destination = (*instr->destination - *instr->source) & 0xFFFF;
+    NEXT();
+  mul:
+    *instr->destination = (*instr->destination * *instr->source) & 0xFFFF;
+    NEXT();
+  div:
+    instructionDIV(*instr);
+    NEXT();
+  cmp:
+    instructionCMP(*instr);
+    NEXT();
+  not_:
+    *instr->destination = ~*instr->destination;
+    NEXT();
+  and_:
+    *instr->destination &= *instr->source;
+    NEXT();
+  or_:
+    *instr->destination |= *instr->source;
+    NEXT();
+  xor_:
+    *instr->destination ^= *instr->source;
+    NEXT();
+  test:
+    instructionTEST(*instr);
+    NEXT();
+  shl:
+    instructionSHL(*instr);
+    NEXT();
+  shr:
+    instructionSHR(*instr);
+    NEXT();
+
+  call_immediate:
+    push(r[7]);
+    r[7] = instr->operand;
+    NEXT();
+  call_register_direct:
+    push(r[7]);
+    r[7] = *instr->source;
+    NEXT();
+  call_register_indirect:
+    push(r[7]);
+    preUpdateSourceRegister(*instr->source, instr->update);
+    r[7] = getMemoryValue(*instr->source);
+    postUpdateSourceRegister(*instr->source, instr->update);
+    NEXT();
+  call_register_indirect_offset:
+    push(r[7]);
+    preUpdateSourceRegister(*instr->source, instr->update);
+    r[7] = getMemoryValue(*instr->source + instr->operand);
+    postUpdateSourceRegister(*instr->source, instr->update);
+    NEXT();
+  call_memory:
+    push(r[7]);
+    r[7] = getMemoryValue(instr->operand);
+    NEXT();
+  call_register_direct_addition:
+    push(r[7]);
+    r[7] = (r[7] + instr->operand) & 0xFFFF;
+    NEXT();
+
+  jmp_immediate:
+    r[7] = instr->operand;
+    NEXT();
+  jmp_register_direct:
+    r[7] = *instr->source;
+    NEXT();
+  jmp_register_indirect:
+    preUpdateSourceRegister(*instr->source, instr->update);
+    r[7] = getMemoryValue(*instr->source);
+    postUpdateSourceRegister(*instr->source, instr->update);
+    NEXT();
+  jmp_register_indirect_offset:
+    preUpdateSourceRegister(*instr->source, instr->update);
+    r[7] = getMemoryValue(*instr->source + instr->operand);
+    postUpdateSourceRegister(*instr->source, instr->update);
+    NEXT();
+  jmp_memory:
+    r[7] = getMemoryValue(instr->operand);
+    NEXT();
+  jmp_register_direct_addition:
+    r[7] = (r[7] + instr->operand) & 0xFFFF;
+    NEXT();
+
+  jeq_immediate:
+    if (getZ()) r[7] = instr->operand;
+    NEXT();
+  jeq_register_direct:
+    if (getZ()) r[7] = *instr->source;
+    NEXT();
+  jeq_register_indirect:
+    if (getZ()) {
+      preUpdateSourceRegister(*instr->source, instr->update);
+      r[7] = getMemoryValue(*instr->source);
+      postUpdateSourceRegister(*instr->source, instr->update);
+    }
+    NEXT();
+  jeq_register_indirect_offset:
+    if (getZ()) {
+      preUpdateSourceRegister(*instr->source, instr->update);
+      r[7] = getMemoryValue(*instr->source + instr->operand);
+      postUpdateSourceRegister(*instr->source, instr->update);
+    }
+    NEXT();
+  jeq_memory:
+    if (getZ()) r[7] = getMemoryValue(instr->operand);
+    NEXT();
+  jeq_register_direct_addition:
+    if (getZ()) r[7] = (r[7] + instr->operand) & 0xFFFF;
+    NEXT();
+
+  jne_immediate:
+    if (!getZ()) r[7] = instr->operand;
+    NEXT();
+  jne_register_direct:
+    if (!getZ()) r[7] = *instr->source;
+    NEXT();
+  jne_register_indirect:
+    if (!getZ()) {
+      preUpdateSourceRegister(*instr->source, instr->update);
+      r[7] = getMemoryValue(*instr->source);
+      postUpdateSourceRegister(*instr->source, instr->update);
+    }
+    NEXT();
+  jne_register_indirect_offset:
+    if (!getZ()) {
+      preUpdateSourceRegister(*instr->source, instr->update);
+      r[7] = getMemoryValue(*instr->source + instr->operand);
+      postUpdateSourceRegister(*instr->source, instr->update);
+    }
+    NEXT();
+  jne_memory:
+    if (!getZ()) r[7] = getMemoryValue(instr->operand);
+    NEXT();
+  jne_register_direct_addition:
+    if (!getZ()) r[7] = (r[7] + instr->operand) & 0xFFFF;
+    NEXT();
+
+  jgt_immediate:
+    if (!getZ() && (getN() == getO())) r[7] = instr->operand;
+    NEXT();
+  jgt_register_direct:
+    if (!getZ() && (getN() == getO())) r[7] = *instr->source;
+    NEXT();
+  jgt_register_indirect:
+    if (!getZ() && (getN() == getO())) {
+      preUpdateSourceRegister(*instr->source, instr->update);
+      r[7] = getMemoryValue(*instr->source);
+      postUpdateSourceRegister(*instr->source, instr->update);
+    }
+    NEXT();
+  jgt_register_indirect_offset:
+    if (!getZ() && (getN() == getO())) {
+      preUpdateSourceRegister(*instr->source, instr->update);
+      r[7] = getMemoryValue(*instr->source + instr->operand);
+      postUpdateSourceRegister(*instr->source, instr->update);
+    }
+    NEXT();
+  jgt_memory:
+    if (!getZ() && (getN() == getO())) r[7] = getMemoryValue(instr->operand);
+    NEXT();
+  jgt_register_direct_addition:
+    if (!getZ() && (getN() == getO())) r[7] = (r[7] + instr->operand) & 0xFFFF;
+    NEXT();
+
+  ldr_immediate:
+    *instr->destination = instr->operand;
+    NEXT();
+  ldr_register_direct:
+    *instr->destination = *instr->source;
+    NEXT();
+  ldr_register_indirect:
+    preUpdateSourceRegister(*instr->source, instr->update);
+    *instr->destination = getMemoryValue(*instr->source);
+    postUpdateSourceRegister(*instr->source, instr->update);
+    NEXT();
+  ldr_register_indirect_offset:
+    preUpdateSourceRegister(*instr->source, instr->update);
+    *instr->destination = getMemoryValue(*instr->source + instr->operand);
+    postUpdateSourceRegister(*instr->source, instr->update);
+    NEXT();
+  ldr_memory:
+    *instr->destination = getMemoryValue(instr->operand);
+    NEXT();
+  ldr_register_direct_addition:
+    *instr->destination = (*instr->source + instr->operand) & 0xFFFF;
+    NEXT();
+
+  str_register_direct:
+    *instr->source = *instr->destination;
+    NEXT();
+  str_register_indirect:
+    preUpdateSourceRegister(*instr->source, instr->update);
+    setMemoryValue(*instr->source, *instr->destination);
+    postUpdateSourceRegister(*instr->source, instr->update);
+    NEXT();
+  str_register_indirect_offset:
+    preUpdateSourceRegister(*instr->source, instr->update);
+    setMemoryValue(*instr->source + instr->operand, *instr->destination);
+    postUpdateSourceRegister(*instr->source, instr->update);
+    NEXT();
+  str_memory:
+    setMemoryValue(instr->operand, *instr->destination);
+    NEXT();
+  str_register_direct_addition:
+    *instr->source = (*instr->destination + instr->operand) & 0xFFFF;
+    NEXT();
+
+  push:
+    push(*instr->destination);
+    NEXT();
+  pop:
+    pop(*instr->destination);
+    NEXT();
+
+  reference:
+    (this->*instr->handler)(*instr);
+    NEXT();
+}
+
+#undef NEXT
+#undef DISPATCH
+#else
+void Emulator::executeThreaded() {
+  executeReference();
+}
+#endif
+
+// interrupts and memory mapped registers are only looked at between translated blocks
+void Emulator::executeJit() {
+  if (jit == nullptr) jit = new JitCompiler(this);
+  if (!jit->available()) {
+    delete jit;
+    jit = nullptr;
+    executeReference();
+    return;
+  }
+  while (true) {
+    int pc = r[7] & 0xFFFF;
+    JitBlock block = jit->blockAt(pc);
+    if (block != nullptr && nextEvent - instructionCount >= MAX_BLOCK_INSTRUCTIONS) { // events stay exact
+      materializeFlags(); // translated code keeps psw in a host register
+      int executed = block(r);
+      if (executed != 0) {
+        afterInstruction(executed);
+        continue;
+      }
+      pc = r[7] & 0xFFFF; // the block left at its first instruction, which the interpreter executes
+    }
+    DecodedInstruction& instr = decodeCache[pc].valid ? decodeCache[pc] : decode(pc);
+    if (pc + instr.length > 0xFFFF) throw PCOutOfBoundsError();
+    r[7] = pc + instr.length;
+    if (instr.opCode == 0x00) break; //halt instruction
+    (this->*instr.handler)(instr);
+    afterInstruction();
+  }
+}
+
+void Emulator::afterInstruction(int executed) {
+  int ch;
+  instructionCount += executed;
+  if (instructionCount >= nextEvent) runEvents();
+  terminal.poll();
+  if ((ch = terminal.read()) >= 0) {
+    setMemoryValue(term_in, ch);
+    interrupts.request(INTERRUPT_TERMINAL, instructionCount);
+  }
+  if (interrupts.pending()) enterInterrupt();
+}
+
+void Emulator::runEvents() {
+  unsigned long long due;
+  while ((due = scheduler.nextDue()) <= instructionCount) {
+    int device = scheduler.popDue(instructionCount);
+    switch (device) {
+      case DEVICE_TIMER:
+        interrupts.request(INTERRUPT_TIMER, instructionCount);
+        scheduleTimer(due); // the next period starts when this one was due, so ticks do not drift
         break;
-      case 0x90:
-        instructionSHL();
+      case DEVICE_INPUT:
+        deliverInput();
         break;
-      case 0x91:
-        instructionSHR();
+      case DEVICE_LIMIT:
+        throw InstructionLimitReached();
+      case DEVICE_WATCHDOG:
+        if (chrono::steady_clock::now() - startTime >= chrono::milliseconds(timeLimit)) throw TimeLimitReached();
+        scheduler.schedule(DEVICE_WATCHDOG, instructionCount + WATCHDOG_INTERVAL);
         break;
-      case 0xA0:
-        instructionLDR();
+      case DEVICE_FLUSH:
+        terminal.flush();
+        scheduleFlush();
         break;
-      case 0xB0:
-        instructionSTR();
+    }
+  }
+  nextEvent = due;
+}
+
+// periods of the timer in milliseconds, indexed by the value in tim_cfg
+static const int timerPeriods[8] = {500, 1000, 1500, 2000, 5000, 10000, 30000, 60000};
+
+void Emulator::scheduleInput() {
+  if (scriptPosition < script.size()) scheduler.schedule(DEVICE_INPUT, script[scriptPosition].at);
+}
+
+void Emulator::deliverInput() {
+  setMemoryValue(term_in, script[scriptPosition++].character);
+  interrupts.request(INTERRUPT_TERMINAL, instructionCount);
+  scheduleInput();
+}
+
+// headless terminals are flushed in virtual time, at the rate the timer's periods use
+void Emulator::scheduleFlush() {
+  unsigned long long period = (unsigned long long)terminal.flushInterval() * INSTRUCTIONS_PER_MILLISECOND / 1000;
+  scheduler.schedule(DEVICE_FLUSH, instructionCount + max(period, 1ULL));
+}
+
+void Emulator::scheduleTimer(unsigned long long from) {
+  int period = timerPeriods[getMemoryValue(tim_cfg) & 7];
+  scheduler.schedule(DEVICE_TIMER, from + (unsigned long long)period * INSTRUCTIONS_PER_MILLISECOND);
+  nextEvent = scheduler.nextDue();
+}
+
+// the page of every register of the device gets the device attribute, writes there go to deviceWrite
+void Emulator::registerDevice(int first, int last, DeviceHandler write) {
+  devices.push_back(Device(first, last, write));
+  for (int page = first >> 8; page <= last >> 8; page++) pageAttributes[page] |= PAGE_DEVICE;
+}
+
+void Emulator::deviceWrite(int address) {
+  for (Device& device: devices) {
+    if (address + 1 >= device.first && address <= device.last) (this->*device.write)(address);
+  }
+}
+
+// both devices have a single register, so the written address tells them nothing
+void Emulator::terminalWrite(int) {
+  int terminalOut = getMemoryValue(term_out);
+  if (terminalOut != 0) {
+    terminal.write((unsigned char)terminalOut);
+    if (terminal.sharesStdout()) terminalBreak = true; // guest output and the final state are on the same stream
+    memory[term_out] = memory[term_out + 1] = 0;
+  }
+}
+
+void Emulator::timerWrite(int) {
+  scheduleTimer(instructionCount);
+}
+
+int* Emulator::registerAddress(short number) {
+  if (number < 8) return &r[number];
+  if (number == 8) return &psw;
+  return &unusedRegister;
+}
+
+DecodedInstruction& Emulator::decode(int address) {
+  DecodedInstruction& instr = decodeCache[address];
+  RegisterDescription regDescr(memory[address + 1]);
+  unsigned char addrMode = memory[address + 2];
+  bool hasAddressMode = false;
+
+  instr.opCode = memory[address];
+  instr.regDest = regDescr.destination;
+  instr.regSrc = regDescr.source;
+  instr.destination = registerAddress(regDescr.destination);
+  instr.source = registerAddress(regDescr.source);
+  instr.addrMode = instr.update = 0;
+  instr.operand = 0;
+  instr.length = 2;
+  switch (instr.opCode) {
+    case 0x00: instr.handler = nullptr; instr.length = 1; break;
+    case 0x10: instr.handler = &Emulator::instructionINT; break;
+    case 0x20: instr.handler = &Emulator::instructionIRET; instr.length = 1; break;
+    case 0x30: instr.handler = &Emulator::instructionCALL; hasAddressMode = true; break;
+    case 0x40: instr.handler = &Emulator::instructionRET; instr.length = 1; break;
+    case 0x50: instr.handler = &Emulator::instructionJMP; hasAddressMode = true; break;
+    case 0x51: instr.handler = &Emulator::instructionJEQ; hasAddressMode = true; break;
+    case 0x52: instr.handler = &Emulator::instructionJNE; hasAddressMode = true; break;
+    case 0x53: instr.handler = &Emulator::instructionJGT; hasAddressMode = true; break;
+    case 0x60: instr.handler = &Emulator::instructionXCHG; break;
+    case 0x70: instr.handler = &Emulator::instructionADD; break;
+    case 0x71: instr.handler = &Emulator::instructionSUB; break;
+    case 0x72: instr.handler = &Emulator::instructionMUL; break;
+    case 0x73: instr.handler = &Emulator::instructionDIV; break;
+    case 0x74: instr.handler = &Emulator::instructionCMP; break;
+    case 0x80: instr.handler = &Emulator::instructionNOT; break;
+    case 0x81: instr.handler = &Emulator::instructionAND; break;
+    case 0x82: instr.handler = &Emulator::instructionOR; break;
+    case 0x83: instr.handler = &Emulator::instructionXOR; break;
+    case 0x84: instr.handler = &Emulator::instructionTEST; break;
+    case 0x90: instr.handler = &Emulator::instructionSHL; break;
+    case 0x91: instr.handler = &Emulator::instructionSHR; break;
+    case 0xA0: instr.handler = &Emulator::instructionLDR; hasAddressMode = true; break;
+    case 0xB0: instr.handler = &Emulator::instructionSTR; hasAddressMode = true; break;
+    default: instr.handler = &Emulator::instructionIllegal; instr.length = 1; break;
+  }
+  if (hasAddressMode) {
+    instr.addrMode = addrMode & 0xF;
+    instr.update = (addrMode & 0xF0) >> 4;
+    switch (instr.addrMode) {
+      case AddressModes::IMMEDIATE:
+      case AddressModes::REGISTER_INDIRECT_OFFSET:
+      case AddressModes::MEMORY:
+      case AddressModes::REGISTER_DIRECT_ADDITION:
+        instr.operand = memory[address + 3] | (memory[address + 4] << 8);
+        instr.length = 5;
         break;
       default:
-        throw IllegalOperationCodeError();
+        instr.length = 3;
         break;
     }
-    terminalOut = getMemoryValue(term_out);
-    if (terminalOut != 0) {
-      printf("%c", (unsigned char)terminalOut);
-      terminalBreak = true;
-      fflush(stdout);
-      setMemoryValue(term_out, 0);
-    }
-    if ((ch = getch()) != 0) {
-      setMemoryValue(term_in, ch);
-      interruptRequests |= 0x08; // terminal intr bit
-    }
-    checkForInterrupts();
+  }
+  instr.threadedHandler = threadedHandlerIndex(instr);
+  if ((instr.regDest == 8 || instr.regSrc == 8) && instr.handler != nullptr) {
+    instr.pswHandler = instr.handler;
+    instr.handler = &Emulator::instructionAccessingPSW;
+    instr.threadedHandler = H_REFERENCE;
+  }
+  for (int page = address >> 8; page <= (address + instr.length - 1) >> 8; page++) pageAttributes[page] |= PAGE_DECODED;
+  instr.valid = true;
+  return instr;
+}
+
+unsigned char Emulator::threadedHandlerIndex(const DecodedInstruction& instr) {
+  bool knownMode = instr.addrMode <= AddressModes::REGISTER_DIRECT_ADDITION;
+  switch (instr.opCode) {
+    case 0x00: return H_HALT;
+    case 0x10: return H_INT;
+    case 0x20: return H_IRET;
+    case 0x30: return knownMode ? H_CALL_IMMEDIATE + instr.addrMode : H_REFERENCE;
+    case 0x40: return H_RET;
+    case 0x50: return knownMode ? H_JMP_IMMEDIATE + instr.addrMode : H_REFERENCE;
+    case 0x51: return knownMode ? H_JEQ_IMMEDIATE + instr.addrMode : H_REFERENCE;
+    case 0x52: return knownMode ? H_JNE_IMMEDIATE + instr.addrMode : H_REFERENCE;
+    case 0x53: return knownMode ? H_JGT_IMMEDIATE + instr.addrMode : H_REFERENCE;
+    case 0x60: return H_XCHG;
+    case 0x70: return H_ADD;
+    case 0x71: return H_SUB;
+    case 0x72: return H_MUL;
+    case 0x73: return H_DIV;
+    case 0x74: return H_CMP;
+    case 0x80: return H_NOT;
+    case 0x81: return H_AND;
+    case 0x82: return H_OR;
+    case 0x83: return H_XOR;
+    case 0x84: return H_TEST;
+    case 0x90: return H_SHL;
+    case 0x91: return H_SHR;
+    case 0xA0:
+      if (instr.addrMode == AddressModes::REGISTER_INDIRECT && instr.update == UpdateModes::POST_INCREMENT && instr.regSrc == 6) return H_POP;
+      return knownMode ? H_LDR_IMMEDIATE + instr.addrMode : H_REFERENCE;
+    case 0xB0:
+      if (instr.addrMode == AddressModes::REGISTER_INDIRECT && instr.update == UpdateModes::PRE_DECREMENT && instr.regSrc == 6) return H_PUSH;
+      return knownMode ? H_STR_IMMEDIATE + instr.addrMode : H_REFERENCE;
+    default: return H_REFERENCE;
   }
 }
 
-void Emulator::writeOutput() {
-  if (terminalBreak) cout << '\n';
-  cout << "------------------------------------------------\n";
-  cout << "Emulated processor executed halt instruction    \n";
-  cout << "Emulated processor state: psw=0b" << PSWbits() << '\n' << hex;
+void Emulator::invalidateDecoded(int address) {
+  // an instruction is at most 5 bytes long, so only the ones starting 4 bytes before the written word can overlap it
+  for (int i = (address >= 4 ? address - 4 : 0); i <= address + 1 && i < 65536; i++) {
+    if (decodeCache[i].valid && i + decodeCache[i].length > address) decodeCache[i].valid = false;
+  }
+  if (jit != nullptr) jit->invalidate(address);
+}
+
+void Emulator::writeOutput(ostream& out, bool halted) {
+  if (terminalBreak) out << '\n';
+  out << "------------------------------------------------\n";
+  if (halted) out << "Emulated processor executed halt instruction    \n";
+  else out << "Emulated processor stopped before a halt         \n";
+  out << "Emulated processor state: psw=0b" << PSWbits() << '\n' << hex;
   for (int i = 0; i < 4; i++) {
-    cout << 'r' << i << "=0x" << setfill('0') << setw(4) << r[i];
-    if (i != 3) cout << "    ";
-    else cout << '\n';
+    out << 'r' << i << "=0x" << setfill('0') << setw(4) << r[i];
+    if (i != 3) out << "    ";
+    else out << '\n';
   }
   for (int i = 4; i < 8; i++) {
-    cout << 'r' << i << "=0x" << setfill('0') << setw(4) << r[i];
-    if (i != 7) cout << "    ";
-    else cout << '\n';
+    out << 'r' << i << "=0x" << setfill('0') << setw(4) << r[i];
+    if (i != 7) out << "    ";
+    else out << '\n';
   }
 }
 
+void Emulator::writeStatistics(ostream& out) {
+  interrupts.writeStatistics(out);
+}
+
 string Emulator::PSWbits() {
   stringstream sstr;
+  materializeFlags();
   unsigned int a = psw;
   for (int i = 0; i < 16; i++){
     sstr << ((a & 0x8000) >> 15);
@@ -158,133 +795,52 @@ string Emulator::PSWbits() {
   return sstr.str();
 }
 
-void Emulator::instructionINT() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
+void Emulator::instructionINT(const DecodedInstruction& instr) {
   push(r[7]);
+  materializeFlags();
   push(psw);
-  r[7] = getMemoryValue((r[regDescr.destination] % 8) * 2);
+  r[7] = getMemoryValue((*instr.destination % 8) * 2);
 }
 
-void Emulator::instructionIRET() {
+void Emulator::instructionIRET(const DecodedInstruction&) {
+  flagOperation = FLAGS_MATERIALIZED; // the popped psw replaces the pending flags
   pop(psw);
+  interrupts.setMask(psw);
   pop(r[7]);
 }
 
-void Emulator::instructionCALL() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  unsigned char addrMode = memory[r[7]];
-  incPC();
-  int update = (addrMode & 0xF0) >> 4;
-  unsigned char dataLow, dataHigh;
-  int offset, addition;
-  switch (addrMode & 0xF){
-    case AddressModes::IMMEDIATE:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      push(r[7]);
-      r[7] = dataLow | (dataHigh << 8);
-      break;
-    case AddressModes::REGISTER_DIRECT:
-      push(r[7]);
-      r[7] = r[regDescr.source];
-      break;
-    case AddressModes::REGISTER_INDIRECT:
-      push(r[7]);
-      preUpdateSourceRegister(r[regDescr.source], update);
-      r[7] = getMemoryValue(r[regDescr.source]);
-      postUpdateSourceRegister(r[regDescr.source], update);
-      break;
-    case AddressModes::REGISTER_INDIRECT_OFFSET:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      push(r[7]);
-      offset = dataLow | (dataHigh << 8);
-      preUpdateSourceRegister(r[regDescr.source], update);
-      r[7] = getMemoryValue(r[regDescr.source] + offset);
-      postUpdateSourceRegister(r[regDescr.source], update);
-      break;
-    case AddressModes::MEMORY:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      push(r[7]);
-      r[7] = getMemoryValue(dataLow | (dataHigh << 8));
-      break;
-    case AddressModes::REGISTER_DIRECT_ADDITION:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      push(r[7]);
-      addition = dataLow | (dataHigh << 8);
-      r[7] += addition;
-      r[7] &= 0xFFFF;
-      break;
-    default:
-      throw IllegalInstructionError("jump or call instuction with unknown address mode");
-      break;
-  }
+void Emulator::instructionCALL(const DecodedInstruction& instr) {
+  push(r[7]);
+  instructionJMP(instr);
 }
 
-void Emulator::instructionRET() {
+void Emulator::instructionRET(const DecodedInstruction&) {
   pop(r[7]);
 }
 
-void Emulator::instructionJMP() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  unsigned char addrMode = memory[r[7]];
-  incPC();
-  int update = (addrMode & 0xF0) >> 4;
-  unsigned char dataLow, dataHigh;
-  int offset, addition;
-  switch (addrMode & 0xF){
+void Emulator::instructionJMP(const DecodedInstruction& instr) {
+  switch (instr.addrMode){
     case AddressModes::IMMEDIATE:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      r[7] = dataLow | (dataHigh << 8);
+      r[7] = instr.operand;
       break;
     case AddressModes::REGISTER_DIRECT:
-      r[7] = r[regDescr.source];
+      r[7] = *instr.source;
       break;
     case AddressModes::REGISTER_INDIRECT:
-      preUpdateSourceRegister(r[regDescr.source], update);
-      r[7] = getMemoryValue(r[regDescr.source]);
-      postUpdateSourceRegister(r[regDescr.source], update);
+      preUpdateSourceRegister(*instr.source, instr.update);
+      r[7] = getMemoryValue(*instr.source);
+      postUpdateSourceRegister(*instr.source, instr.update);
       break;
     case AddressModes::REGISTER_INDIRECT_OFFSET:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      offset = dataLow | (dataHigh << 8);
-      preUpdateSourceRegister(r[regDescr.source], update);
-      r[7] = getMemoryValue(r[regDescr.source] + offset);
-      postUpdateSourceRegister(r[regDescr.source], update);
+      preUpdateSourceRegister(*instr.source, instr.update);
+      r[7] = getMemoryValue(*instr.source + instr.operand);
+      postUpdateSourceRegister(*instr.source, instr.update);
       break;
     case AddressModes::MEMORY:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      r[7] = getMemoryValue(dataLow | (dataHigh << 8));
+      r[7] = getMemoryValue(instr.operand);
       break;
     case AddressModes::REGISTER_DIRECT_ADDITION:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      addition = dataLow | (dataHigh << 8);
-      r[7] += addition;
+      r[7] += instr.operand;
       r[7] &= 0xFFFF;
       break;
     default:
@@ -293,266 +849,120 @@ void Emulator::instructionJMP() {
   }
 }
 
-void Emulator::instructionJEQ() {
-  if (getZ()) instructionJMP();
-  else {
-    int incCnt;
-    unsigned char addrMode = memory[r[7] + 1] & 0xF;
-    switch (addrMode)
-    {
-    case IMMEDIATE:
-    case REGISTER_DIRECT_ADDITION:
-    case REGISTER_INDIRECT_OFFSET:
-    case MEMORY:
-      incCnt = 4;
-      break;
-    case REGISTER_DIRECT:
-    case REGISTER_INDIRECT:
-      incCnt = 2;
-      break;
-    }
-    for (int i = 0; i < incCnt; i++) incPC();
-  }
-}
-
-void Emulator::instructionJNE() {
-  if (!getZ()) instructionJMP();
-  else {
-    int incCnt;
-    unsigned char addrMode = memory[r[7] + 1] & 0xF;
-    switch (addrMode)
-    {
-    case IMMEDIATE:
-    case REGISTER_DIRECT_ADDITION:
-    case REGISTER_INDIRECT_OFFSET:
-    case MEMORY:
-      incCnt = 4;
-      break;
-    case REGISTER_DIRECT:
-    case REGISTER_INDIRECT:
-      incCnt = 2;
-      break;
-    }
-    for (int i = 0; i < incCnt; i++) incPC();
-  }
-}
-
-void Emulator::instructionJGT() {
-  if (!getZ() && (getN() == getO())) instructionJMP();
-  else {
-    int incCnt;
-    unsigned char addrMode = memory[r[7] + 1] & 0xF;
-    switch (addrMode)
-    {
-    case IMMEDIATE:
-    case REGISTER_DIRECT_ADDITION:
-    case REGISTER_INDIRECT_OFFSET:
-    case MEMORY:
-      incCnt = 4;
-      break;
-    case REGISTER_DIRECT:
-    case REGISTER_INDIRECT:
-      incCnt = 2;
-      break;
-    }
-    for (int i = 0; i < incCnt; i++) incPC();
-  }
+// pc already points past the instruction, so a jump that is not taken needs no further work
+void Emulator::instructionJEQ(const DecodedInstruction& instr) {
+  if (getZ()) instructionJMP(instr);
 }
 
-void Emulator::instructionXCHG() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  int temp = r[regDescr.destination];
-  r[regDescr.destination] = r[regDescr.source];
-  r[regDescr.source] = temp & 0xFFFF;
+void Emulator::instructionJNE(const DecodedInstruction& instr) {
+  if (!getZ()) instructionJMP(instr);
 }
 
-void Emulator::instructionADD() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  r[regDescr.destination] += r[regDescr.source];
-  r[regDescr.destination] &= 0xFFFF;
+void Emulator::instructionJGT(const DecodedInstruction& instr) {
+  if (!getZ() && (getN() == getO())) instructionJMP(instr);
 }
 
-void Emulator::instructionSUB() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  r[regDescr.destination] -= r[regDescr.source];
-  r[regDescr.destination] &= 0xFFFF;
+void Emulator::instructionXCHG(const DecodedInstruction& instr) {
+  int temp = *instr.destination;
+  *instr.destination = *instr.source;
+  *instr.source = temp & 0xFFFF;
 }
 
-void Emulator::instructionMUL() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  r[regDescr.destination] *= r[regDescr.source];
-  r[regDescr.destination] &= 0xFFFF;
+void Emulator::instructionADD(const DecodedInstruction& instr) {
+  *instr.destination += *instr.source;
+  *instr.destination &= 0xFFFF;
 }
 
-void Emulator::instructionDIV() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  if (r[regDescr.source] == 0) throw IllegalInstructionError("division by zero");
-  r[regDescr.destination] /= r[regDescr.source];
-  r[regDescr.destination] &= 0xFFFF;
+void Emulator::instructionSUB(const DecodedInstruction& instr) {
+  *instr.destination -= *instr.source;
+  *instr.destination &= 0xFFFF;
 }
 
-void Emulator::instructionCMP() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  int temp = r[regDescr.destination] - r[regDescr.source];
-  // update psw
-  if (temp == 0) setZ();
-  else resetZ();
-
-  if ((temp & 0x8000) != 0) setN();
-  else resetN();
-
-  if ((temp >> 16) != 0) setC();
-  else resetC();
-
-  int destinationRegisterSign = (r[regDescr.destination] & 0x8000) >> 15;
-  int sourceRegisterSign = (r[regDescr.source] & 0x8000) >> 15;
-  int resultSign = (temp & 0x8000) >> 15;
-
-  if ((destinationRegisterSign == 0 && sourceRegisterSign == 1 && resultSign == 1) ||
-  (destinationRegisterSign == 1 && sourceRegisterSign == 0 && resultSign == 0)) setO();
-  else resetO();
+void Emulator::instructionMUL(const DecodedInstruction& instr) {
+  *instr.destination *= *instr.source;
+  *instr.destination &= 0xFFFF;
 }
 
-void Emulator::instructionNOT() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  r[regDescr.destination] = ~r[regDescr.destination];
+void Emulator::instructionDIV(const DecodedInstruction& instr) {
+  if (*instr.source == 0) throw IllegalInstructionError("division by zero");
+  *instr.destination /= *instr.source;
+  *instr.destination &= 0xFFFF;
 }
 
-void Emulator::instructionAND() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  r[regDescr.destination] &= r[regDescr.source];
+void Emulator::instructionCMP(const DecodedInstruction& instr) {
+  setFlags(FLAGS_CMP, *instr.destination - *instr.source, *instr.destination, *instr.source);
 }
 
-void Emulator::instructionOR() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  r[regDescr.destination] |= r[regDescr.source];
+void Emulator::instructionNOT(const DecodedInstruction& instr) {
+  *instr.destination = ~*instr.destination;
 }
 
-void Emulator::instructionXOR() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  r[regDescr.destination] ^= r[regDescr.source];
+void Emulator::instructionAND(const DecodedInstruction& instr) {
+  *instr.destination &= *instr.source;
 }
 
-void Emulator::instructionTEST() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  int temp = r[regDescr.destination] & r[regDescr.source];
-  // update psw
-  if (temp == 0) setZ();
-  else resetZ();
-
-  if ((temp & 0x8000) != 0) setN();
-  else resetN();
+void Emulator::instructionOR(const DecodedInstruction& instr) {
+  *instr.destination |= *instr.source;
 }
 
-void Emulator::instructionSHL() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  if ((r[regDescr.source] & 0x8000) != 0) throw IllegalInstructionError("negative shift operand");
-  r[regDescr.destination] <<= r[regDescr.source];
-  int result = r[regDescr.destination];
-  // update psw
-  if ((result & 0xFFFF) == 0) setZ();
-  else resetZ();
-
-  if ((result & 0x8000) != 0) setN();
-  else resetN();
-
-  if ((result >> 16) != 0) setC();
-  else resetC();
+void Emulator::instructionXOR(const DecodedInstruction& instr) {
+  *instr.destination ^= *instr.source;
+}
 
-  r[regDescr.destination] &= 0xFFFF;
+void Emulator::instructionTEST(const DecodedInstruction& instr) {
+  setFlags(FLAGS_TEST, *instr.destination & *instr.source, 0, 0);
 }
 
-void Emulator::instructionSHR() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  if ((r[regDescr.source] & 0x8000) != 0) throw IllegalInstructionError("negative shift operand");
-  int initialValue = r[regDescr.destination];
-  r[regDescr.destination] >>= r[regDescr.source];
-  int result = r[regDescr.destination];
-  // update psw
-  if (result == 0) setZ();
-  else resetZ();
+void Emulator::instructionSHL(const DecodedInstruction& instr) {
+  if ((*instr.source & 0x8000) != 0) throw IllegalInstructionError("negative shift operand");
+  *instr.destination <<= *instr.source;
+  int result = *instr.destination;
+  setFlags(FLAGS_SHL, result & 0xFFFF, result, 0);
+  *instr.destination &= 0xFFFF;
+}
 
-  if ((result & 0x8000) != 0) setN();
-  else resetN();
+void Emulator::instructionSHR(const DecodedInstruction& instr) {
+  if ((*instr.source & 0x8000) != 0) throw IllegalInstructionError("negative shift operand");
+  int initialValue = *instr.destination;
+  *instr.destination >>= *instr.source;
+  setFlags(FLAGS_SHR, *instr.destination, initialValue, *instr.source);
+}
 
-  bool cFlagSet = false;
-  for (int i = 0; i < r[regDescr.source]; i++) {
-    if ((initialValue & 1) == 0) {
-      setC();
-      cFlagSet = true;
-      break;
-    }
-    initialValue >>= 1;
-  }
-  if (!cFlagSet) resetC();
+// the instruction may read or write psw, so it has to see every flag
+void Emulator::instructionAccessingPSW(const DecodedInstruction& instr) {
+  materializeFlags();
+  (this->*instr.pswHandler)(instr);
+  interrupts.setMask(psw);
 }
 
-void Emulator::instructionLDR() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  unsigned char addrMode = memory[r[7]];
-  incPC();
-  int update = (addrMode & 0xF0) >> 4;
-  unsigned char dataLow, dataHigh;
-  int offset, addition;
-  switch (addrMode & 0xF){
+void Emulator::instructionLDR(const DecodedInstruction& instr) {
+  switch (instr.addrMode){
     case AddressModes::IMMEDIATE:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      r[regDescr.destination] = dataLow | (dataHigh << 8);
+      *instr.destination = instr.operand;
       break;
     case AddressModes::REGISTER_DIRECT:
-      r[regDescr.destination] = r[regDescr.source];
+      *instr.destination = *instr.source;
       break;
     case AddressModes::REGISTER_INDIRECT:
-      if (update == UpdateModes::POST_INCREMENT & regDescr.source == 6) { //pop instruction
-        pop(r[regDescr.destination]);
+      if (instr.update == UpdateModes::POST_INCREMENT && instr.regSrc == 6) { //pop instruction
+        pop(*instr.destination);
         return;
       }
-      preUpdateSourceRegister(r[regDescr.source], update);
-      r[regDescr.destination] = getMemoryValue(r[regDescr.source]);
-      postUpdateSourceRegister(r[regDescr.source], update);
+      preUpdateSourceRegister(*instr.source, instr.update);
+      *instr.destination = getMemoryValue(*instr.source);
+      postUpdateSourceRegister(*instr.source, instr.update);
       break;
     case AddressModes::REGISTER_INDIRECT_OFFSET:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      offset = dataLow | (dataHigh << 8);
-      preUpdateSourceRegister(r[regDescr.source], update);
-      r[regDescr.destination] = getMemoryValue(r[regDescr.source] + offset);
-      postUpdateSourceRegister(r[regDescr.source], update);
+      preUpdateSourceRegister(*instr.source, instr.update);
+      *instr.destination = getMemoryValue(*instr.source + instr.operand);
+      postUpdateSourceRegister(*instr.source, instr.update);
       break;
     case AddressModes::MEMORY:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      r[regDescr.destination] = getMemoryValue(dataLow | (dataHigh << 8));
+      *instr.destination = getMemoryValue(instr.operand);
       break;
     case AddressModes::REGISTER_DIRECT_ADDITION:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      addition = dataLow | (dataHigh << 8);
-      r[regDescr.destination] = r[regDescr.source] + addition;
-      r[regDescr.destination] &= 0xFFFF;
+      *instr.destination = *instr.source + instr.operand;
+      *instr.destination &= 0xFFFF;
       break;
     default:
       throw IllegalInstructionError("instuction ldr with unknown address mode");
@@ -560,55 +970,34 @@ void Emulator::instructionLDR() {
   }
 }
 
-void Emulator::instructionSTR() {
-  RegisterDescription regDescr(memory[r[7]]);
-  incPC();
-  unsigned char addrMode = memory[r[7]];
-  incPC();
-  int update = (addrMode & 0xF0) >> 4;
-  unsigned char dataLow, dataHigh;
-  int offset, addition;
-  switch (addrMode & 0xF){
+void Emulator::instructionSTR(const DecodedInstruction& instr) {
+  switch (instr.addrMode){
     case AddressModes::IMMEDIATE:
       throw IllegalInstructionError("instruction str with immediate address mode");
       break;
     case AddressModes::REGISTER_DIRECT:
-      r[regDescr.source] = r[regDescr.destination];
+      *instr.source = *instr.destination;
       break;
     case AddressModes::REGISTER_INDIRECT:
-      if (update == UpdateModes::PRE_DECREMENT & regDescr.source == 6) { //push instruction
-        push(r[regDescr.destination]);
+      if (instr.update == UpdateModes::PRE_DECREMENT && instr.regSrc == 6) { //push instruction
+        push(*instr.destination);
         return;
       }
-      preUpdateSourceRegister(r[regDescr.source], update);
-      setMemoryValue(r[regDescr.source], r[regDescr.destination]);
-      postUpdateSourceRegister(r[regDescr.source], update);
+      preUpdateSourceRegister(*instr.source, instr.update);
+      setMemoryValue(*instr.source, *instr.destination);
+      postUpdateSourceRegister(*instr.source, instr.update);
       break;
     case AddressModes::REGISTER_INDIRECT_OFFSET:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      offset = dataLow | (dataHigh << 8);
-      preUpdateSourceRegister(r[regDescr.source], update);
-      setMemoryValue(r[regDescr.source] + offset, r[regDescr.destination]);
-      postUpdateSourceRegister(r[regDescr.source], update);
+      preUpdateSourceRegister(*instr.source, instr.update);
+      setMemoryValue(*instr.source + instr.operand, *instr.destination);
+      postUpdateSourceRegister(*instr.source, instr.update);
       break;
     case AddressModes::MEMORY:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      setMemoryValue(dataLow | (dataHigh << 8), r[regDescr.destination]);
+      setMemoryValue(instr.operand, *instr.destination);
       break;
     case AddressModes::REGISTER_DIRECT_ADDITION:
-      dataLow = memory[r[7]];
-      incPC();
-      dataHigh = memory[r[7]];
-      incPC();
-      addition = dataLow | (dataHigh << 8);
-      r[regDescr.source] = r[regDescr.destination] + addition;
-      r[regDescr.source] &= 0xFFFF;
+      *instr.source = *instr.destination + instr.operand;
+      *instr.source &= 0xFFFF;
       break;
     default:
       throw IllegalInstructionError("instuction ldr with unknown address mode");
@@ -616,24 +1005,61 @@ void Emulator::instructionSTR() {
   }
 }
 
-void Emulator::checkForInterrupts() {
-  unsigned char intr = interruptRequests;
-  if (intr == 0) return;
-  unsigned char mask = 2;
-  bool interruptMasked = getI();
-  for (int i = 1; i < 8; i++) {
-    if ((intr & mask) != 0 && !interruptMasked) {
-      if ((i == 2 && !getTr()) || (i == 3 && !getTl()) || (i != 2 && i != 3)) {
-        push(r[7]);
-        push(psw);
-        setI();
-        r[7] = getMemoryValue(i * 2);
-        interruptRequests &= ~(1 << i);
-        return;
-      }
-    }
-    mask <<= 1;
+void Emulator::instructionIllegal(const DecodedInstruction&) {
+  throw IllegalOperationCodeError();
+}
+
+void Emulator::enterInterrupt() {
+  int line = interrupts.acknowledge(instructionCount);
+  push(r[7]);
+  materializeFlags();
+  push(psw);
+  setI();
+  interrupts.setMask(psw);
+  r[7] = getMemoryValue(line * 2);
+}
+
+// flags are only recorded here and turned into psw bits when something reads them
+void Emulator::setFlags(int operation, int result, int destination, int source) {
+  // flags the new operation leaves alone have to be in psw already
+  if (flagOperation != FLAGS_MATERIALIZED && flagOperation != operation && operation != FLAGS_CMP &&
+    !(flagOperation == FLAGS_TEST && operation >= FLAGS_SHL) && !(flagOperation >= FLAGS_SHL && operation >= FLAGS_SHL)) computeFlags();
+  flagOperation = operation;
+  flagResult = result;
+  flagDestination = destination;
+  flagSource = source;
+}
+
+bool Emulator::lazyO() const {
+  int destinationRegisterSign = (flagDestination & 0x8000) >> 15;
+  int sourceRegisterSign = (flagSource & 0x8000) >> 15;
+  int resultSign = (flagResult & 0x8000) >> 15;
+  return (destinationRegisterSign == 0 && sourceRegisterSign == 1 && resultSign == 1) ||
+    (destinationRegisterSign == 1 && sourceRegisterSign == 0 && resultSign == 0);
+}
+
+bool Emulator::lazyC() const {
+  if (flagOperation == FLAGS_CMP) return (flagResult >> 16) != 0;
+  if (flagOperation == FLAGS_SHL) return (flagDestination >> 16) != 0;
+  int initialValue = flagDestination;
+  for (int i = 0; i < flagSource; i++) {
+    if ((initialValue & 1) == 0) return true;
+    initialValue >>= 1;
   }
+  return false;
+}
+
+void Emulator::computeFlags() {
+  bool z = getZ(), n = getN(), c = getC(), o = getO();
+  flagOperation = FLAGS_MATERIALIZED;
+  if (z) setZ();
+  else resetZ();
+  if (n) setN();
+  else resetN();
+  if (c) setC();
+  else resetC();
+  if (o) setO();
+  else resetO();
 }
 
 void Emulator::setZ() {psw |= 1;}
@@ -657,11 +1083,6 @@ void Emulator::resetTl() {psw &= 0xBFFF;}
 void Emulator::setI() {psw |= 0x8000;}
 void Emulator::resetI() {psw &= 0x7FFF;}
 
-void Emulator::incPC() {
-  r[7]++;
-  if ((r[7] & 0xFFFF) == 0) throw PCOutOfBoundsError();
-}
-
 void Emulator::push(int& destinationRegister) {
   r[6] -= 2;
   if (r[6] <= maxAddress) throw StackOverflow();
@@ -708,33 +1129,76 @@ void Emulator::setMemoryValue(int address, int value) {
   int adr = address & 0xFFFF;
   memory[adr] = value & 0xFF;
   memory[adr + 1] = (value & 0xFF00) >> 8;
+  unsigned char attributes = pageAttributes[adr >> 8] | pageAttributes[(adr + 1) >> 8];
+  if (attributes == 0) return;
+  if (attributes & PAGE_DECODED) invalidateDecoded(adr);
+  if (attributes & PAGE_DEVICE) deviceWrite(adr);
 }
 
+// exit status: 0 after halt, 1 after a fault or bad arguments, 2 when a limit stopped the emulation
 int main(int argc, char* argv[]) {
-  // terminal configuration
   termios newt, oldt;
-  tcgetattr(STDIN_FILENO, &oldt);
-  newt = oldt;
-  newt.c_lflag &= ~ICANON;
-  newt.c_lflag &= ~ECHO;
-  newt.c_cc[VTIME] = 0;
-  newt.c_cc[VMIN] = 0;
-  tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+  bool rawTerminal = false;
+  int status = 0;
   try {
-    Emulator* emulator = nullptr;
+    unique_ptr<Emulator> emulator; // destroyed on every way out, which flushes the terminal and closes -output
+    EmulatorOptions options;
+    string manifest, report, value;
+    int jobs = 0;
 
-    if (argc < 2) throw InvalidCmdArgs();
-    emulator = new Emulator(argv[1]);
+    for (int ind = 1; ind < argc; ind++) {
+      if (options.parse(argv[ind])) continue;
+      if (optionValue(argv[ind], "-batch=", value)) manifest = value;
+      else if (optionValue(argv[ind], "-jobs=", value)) jobs = numberValue(value);
+      else if (optionValue(argv[ind], "-report=", value)) report = value;
+      else if (options.input.empty() && argv[ind][0] != '-') options.input = argv[ind];
+      else throw InvalidCmdArgs();
+    }
 
-    emulator->loadMemory();
-    emulator->execute();
-    emulator->writeOutput();
+    if (!manifest.empty()) {
+      // options given next to the manifest are the defaults of its lines
+      BatchRunner runner(manifest, options, jobs);
+      runner.run();
+      if (report.empty()) runner.writeReport(cout);
+      else {
+        ofstream out(report);
+        if (!out.is_open()) throw UnknownFileError(report.c_str());
+        runner.writeReport(out);
+      }
+      return runner.status();
+    }
+
+    if (options.input.empty()) throw InvalidCmdArgs();
+    emulator.reset(new Emulator(options.input, options.engine));
+    emulator->configure(options);
+    if (!options.headless) {
+      // terminal configuration
+      tcgetattr(STDIN_FILENO, &oldt);
+      newt = oldt;
+      newt.c_lflag &= ~ICANON;
+      newt.c_lflag &= ~ECHO;
+      newt.c_cc[VTIME] = 0;
+      newt.c_cc[VMIN] = 0;
+      tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+      rawTerminal = true;
+    }
 
-    if (emulator != nullptr) delete emulator;
+    try {
+      emulator->loadMemory();
+      emulator->execute();
+      emulator->writeOutput();
+      if (options.statistics) emulator->writeStatistics();
+    }
+    catch(const EmulationLimitReached& e) {
+      cout << e.what() << '\n';
+      if (options.statistics) emulator->writeStatistics();
+      status = 2;
+    }
   }
   catch(const exception& e) {
     cout << e.what() << '\n';
+    status = 1;
   }
-  tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-  return 0;
-}
\ No newline at end of file
+  if (rawTerminal) tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+  return status;
+}
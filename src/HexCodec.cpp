@@ -0,0 +1,202 @@
+#include "../inc/HexCodec.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEX_SIMD
+#endif
+
+static const char digits[] = "0123456789ABCDEF";
+
+static int digitValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+void appendHex(std::string& out, unsigned value, int count) {
+  for (int i = count - 1; i >= 0; i--) out += digits[(value >> (i * 4)) & 0xF];
+}
+
+#ifdef HEX_SIMD
+
+/* Token i of a block occupies characters 3i (high digit), 3i + 1 (low digit) and 3i + 2 (separator).
+ * A block of 16 tokens is 48 characters, three 16 byte registers. The masks gather the high digits,
+ * the low digits and the separators of every register into token order, 0x80 marks a token
+ * that comes from another register. */
+static unsigned char gatherMask[3][3][16];  // [register][high, low, separator][token]
+static unsigned char scatterMask[3][2][16]; // [register][high, low][character]
+static unsigned char separatorMask[3][16];  // [register][character], 0xFF where the separator goes
+
+static int detectLevel() {
+  for (int reg = 0; reg < 3; reg++) {
+    for (int kind = 0; kind < 3; kind++) {
+      for (int token = 0; token < 16; token++) {
+        int position = 3 * token + kind;
+        gatherMask[reg][kind][token] = position / 16 == reg ? position % 16 : 0x80;
+      }
+    }
+    for (int local = 0; local < 16; local++) {
+      int position = 16 * reg + local;
+      int kind = position % 3;
+      scatterMask[reg][0][local] = kind == 0 ? position / 3 : 0x80;
+      scatterMask[reg][1][local] = kind == 1 ? position / 3 : 0x80;
+      separatorMask[reg][local] = kind == 2 ? 0xFF : 0;
+    }
+  }
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return 2;
+  if (__builtin_cpu_supports("ssse3")) return 1;
+  return 0;
+}
+
+static int level = detectLevel(); // 0 scalar, 1 SSSE3, 2 AVX2
+
+__attribute__((target("ssse3")))
+static __m128i nibbles128(__m128i characters, int& valid) {
+  __m128i digit = _mm_sub_epi8(characters, _mm_set1_epi8('0'));
+  __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  __m128i letter = _mm_sub_epi8(_mm_or_si128(characters, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+  valid &= _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) == 0xFFFF;
+  return _mm_or_si128(_mm_and_si128(digit, isDigit), _mm_and_si128(_mm_add_epi8(letter, _mm_set1_epi8(10)), isLetter));
+}
+
+// 48 characters to 16 bytes, false if any token or separator is malformed
+__attribute__((target("ssse3")))
+static bool decodeBlock16(const char* text, char separator, unsigned char* out) {
+  __m128i reg[3];
+  for (int i = 0; i < 3; i++) reg[i] = _mm_loadu_si128((const __m128i*)(text + 16 * i));
+  __m128i gathered[3];
+  for (int kind = 0; kind < 3; kind++) {
+    gathered[kind] = _mm_setzero_si128();
+    for (int i = 0; i < 3; i++)
+      gathered[kind] = _mm_or_si128(gathered[kind], _mm_shuffle_epi8(reg[i], _mm_loadu_si128((const __m128i*)gatherMask[i][kind])));
+  }
+  int valid = _mm_movemask_epi8(_mm_cmpeq_epi8(gathered[2], _mm_set1_epi8(separator))) == 0xFFFF;
+  __m128i high = nibbles128(gathered[0], valid);
+  __m128i low = nibbles128(gathered[1], valid);
+  if (!valid) return false;
+  __m128i bytes = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(high, 4), _mm_set1_epi8((char)0xF0)), low);
+  _mm_storeu_si128((__m128i*)out, bytes);
+  return true;
+}
+
+__attribute__((target("avx2")))
+static __m256i nibbles256(__m256i characters, int& valid) {
+  __m256i digit = _mm256_sub_epi8(characters, _mm256_set1_epi8('0'));
+  __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+  __m256i letter = _mm256_sub_epi8(_mm256_or_si256(characters, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  __m256i isLetter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+  valid &= _mm256_movemask_epi8(_mm256_or_si256(isDigit, isLetter)) == -1;
+  return _mm256_or_si256(_mm256_and_si256(digit, isDigit), _mm256_and_si256(_mm256_add_epi8(letter, _mm256_set1_epi8(10)), isLetter));
+}
+
+// two blocks at once, the lower lanes hold the first block and the upper lanes the second
+__attribute__((target("avx2")))
+static bool decodeBlock32(const char* text, char separator, unsigned char* out) {
+  __m256i reg[3];
+  for (int i = 0; i < 3; i++) {
+    __m128i first = _mm_loadu_si128((const __m128i*)(text + 16 * i));
+    __m128i second = _mm_loadu_si128((const __m128i*)(text + 48 + 16 * i));
+    reg[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+  }
+  __m256i gathered[3];
+  for (int kind = 0; kind < 3; kind++) {
+    gathered[kind] = _mm256_setzero_si256();
+    for (int i = 0; i < 3; i++)
+      gathered[kind] = _mm256_or_si256(gathered[kind], _mm256_shuffle_epi8(reg[i], _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)gatherMask[i][kind]))));
+  }
+  int valid = _mm256_movemask_epi8(_mm256_cmpeq_epi8(gathered[2], _mm256_set1_epi8(separator))) == -1;
+  __m256i high = nibbles256(gathered[0], valid);
+  __m256i low = nibbles256(gathered[1], valid);
+  if (!valid) return false;
+  __m256i bytes = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(high, 4), _mm256_set1_epi8((char)0xF0)), low);
+  _mm256_storeu_si256((__m256i*)out, bytes);
+  return true;
+}
+
+// 16 bytes to 48 characters
+__attribute__((target("ssse3")))
+static void encodeBlock16(const unsigned char* bytes, char separator, char* out) {
+  __m128i lookup = _mm_loadu_si128((const __m128i*)digits);
+  __m128i v = _mm_loadu_si128((const __m128i*)bytes);
+  __m128i high = _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F)));
+  __m128i low = _mm_shuffle_epi8(lookup, _mm_and_si128(v, _mm_set1_epi8(0x0F)));
+  __m128i separators = _mm_set1_epi8(separator);
+  for (int i = 0; i < 3; i++) {
+    __m128i characters = _mm_or_si128(_mm_shuffle_epi8(high, _mm_loadu_si128((const __m128i*)scatterMask[i][0])),
+      _mm_shuffle_epi8(low, _mm_loadu_si128((const __m128i*)scatterMask[i][1])));
+    characters = _mm_or_si128(characters, _mm_and_si128(separators, _mm_loadu_si128((const __m128i*)separatorMask[i])));
+    _mm_storeu_si128((__m128i*)(out + 16 * i), characters);
+  }
+}
+
+__attribute__((target("avx2")))
+static void encodeBlock32(const unsigned char* bytes, char separator, char* out) {
+  __m256i lookup = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)digits));
+  __m256i v = _mm256_loadu_si256((const __m256i*)bytes);
+  __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F)));
+  __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, _mm256_set1_epi8(0x0F)));
+  __m256i separators = _mm256_set1_epi8(separator);
+  for (int i = 0; i < 3; i++) {
+    __m256i characters = _mm256_or_si256(
+      _mm256_shuffle_epi8(high, _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)scatterMask[i][0]))),
+      _mm256_shuffle_epi8(low, _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)scatterMask[i][1]))));
+    characters = _mm256_or_si256(characters,
+      _mm256_and_si256(separators, _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)separatorMask[i]))));
+    _mm_storeu_si128((__m128i*)(out + 16 * i), _mm256_castsi256_si128(characters));
+    _mm_storeu_si128((__m128i*)(out + 48 + 16 * i), _mm256_extracti128_si256(characters, 1));
+  }
+}
+
+#endif
+
+long decodeHex(const char* text, size_t length, char separator, unsigned char* out, size_t maxCount) {
+  size_t position = 0, count = 0;
+#ifdef HEX_SIMD
+  // a block is only taken when the separator after its last token is there as well
+  if (level >= 2) {
+    while (position + 96 <= length && count + 32 <= maxCount && decodeBlock32(text + position, separator, out + count)) {
+      position += 96;
+      count += 32;
+    }
+  }
+  if (level >= 1) {
+    while (position + 48 <= length && count + 16 <= maxCount && decodeBlock16(text + position, separator, out + count)) {
+      position += 48;
+      count += 16;
+    }
+  }
+#endif
+  while (position < length && count < maxCount) {
+    if (position + 2 > length) return -1;
+    int high = digitValue(text[position]), low = digitValue(text[position + 1]);
+    if (high < 0 || low < 0) return -1;
+    out[count++] = (high << 4) | low;
+    position += 2;
+    if (position < length) {
+      if (text[position] != separator) return -1;
+      position++;
+    }
+  }
+  return count;
+}
+
+void encodeHex(const unsigned char* bytes, size_t count, char separator, char* out) {
+  size_t i = 0;
+#ifdef HEX_SIMD
+  if (level >= 2) {
+    for (; i + 32 <= count; i += 32) encodeBlock32(bytes + i, separator, out + 3 * i);
+  }
+  if (level >= 1) {
+    for (; i + 16 <= count; i += 16) encodeBlock16(bytes + i, separator, out + 3 * i);
+  }
+#endif
+  for (; i < count; i++) {
+    out[3 * i] = digits[bytes[i] >> 4];
+    out[3 * i + 1] = digits[bytes[i] & 0xF];
+    out[3 * i + 2] = separator;
+  }
+}
@@ -0,0 +1,52 @@
+#include "../inc/InterruptController.hpp"
+#include <iomanip>
+
+static const char* lineNames[INTERRUPT_LINES] = {"reset", "error", "timer", "terminal", "line 4", "line 5", "line 6", "line 7"};
+
+InterruptController::InterruptController() : requests(0), enabled(0), deliverable(0) {
+  for (int i = 0; i < INTERRUPT_LINES; i++) requestedAt[i] = requested[i] = delivered[i] = totalLatency[i] = maxLatency[i] = 0;
+  setMask(0);
+}
+
+void InterruptController::request(int line, unsigned long long now) {
+  requested[line]++;
+  if ((requests & (1 << line)) == 0) requestedAt[line] = now;
+  requests |= 1 << line;
+  deliverable = requests & enabled;
+}
+
+void InterruptController::setMask(int psw) {
+  if (psw & 0x8000) enabled = 0; // I masks every line
+  else {
+    enabled = 0xFE; // reset is never delivered as an interrupt
+    if (psw & 0x2000) enabled &= ~(1 << INTERRUPT_TIMER);
+    if (psw & 0x4000) enabled &= ~(1 << INTERRUPT_TERMINAL);
+  }
+  deliverable = requests & enabled;
+}
+
+int InterruptController::acknowledge(unsigned long long now) {
+  int line = 0;
+  while ((deliverable & (1 << line)) == 0) line++;
+  requests &= ~(1 << line);
+  deliverable = requests & enabled;
+
+  unsigned long long latency = now - requestedAt[line];
+  delivered[line]++;
+  totalLatency[line] += latency;
+  if (latency > maxLatency[line]) maxLatency[line] = latency;
+  return line;
+}
+
+void InterruptController::writeStatistics(std::ostream& out) const {
+  out << "Interrupt statistics (latency in instructions from request to handler entry)\n";
+  out << std::dec << std::setfill(' ');
+  for (int i = 0; i < INTERRUPT_LINES; i++) {
+    if (requested[i] == 0) continue;
+    out << std::setw(10) << std::left << lineNames[i] << std::right
+      << " requested=" << requested[i]
+      << " delivered=" << delivered[i]
+      << " avg latency=" << (delivered[i] ? totalLatency[i] / delivered[i] : 0)
+      << " max latency=" << maxLatency[i] << '\n';
+  }
+}
@@ -0,0 +1,480 @@
+#include "../inc/Jit.hpp"
+#include "../inc/Emulator.hpp"
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+
+using namespace std;
+
+#define HOT_THRESHOLD 50
+#define NEVER_TRANSLATE 0xFFFF
+#define CODE_BUFFER_SIZE (4 << 20)
+
+#if defined(__x86_64__)
+
+enum HostRegisters{
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// guest r0..r6 and psw stay in r8d..r15d for the whole block, pc is a constant at translation time
+const int hostRegister[9] = {R8, R9, R10, R11, R12, R13, R14, -1, R15};
+
+enum AluOperations{ // opcode of "op r/m32, r32" and the /digit of "op r/m32, imm32"
+  ALU_ADD = 0x01,
+  ALU_OR = 0x09,
+  ALU_SBB = 0x19,
+  ALU_AND = 0x21,
+  ALU_SUB = 0x29,
+  ALU_XOR = 0x31,
+  ALU_CMP = 0x39,
+  ALU_MOV = 0x89,
+  ALU_TEST = 0x85
+};
+
+int immediateDigit(AluOperations op) {
+  switch (op) {
+    case ALU_ADD: return 0;
+    case ALU_OR: return 1;
+    case ALU_AND: return 4;
+    case ALU_SUB: return 5;
+    case ALU_XOR: return 6;
+    case ALU_CMP: return 7;
+    default: return 0;
+  }
+}
+
+/* minimal x86-64 encoder for the instructions the translator needs */
+class X86Emitter{
+private:
+  unsigned char* code;
+  size_t capacity;
+public:
+  size_t pos;
+  bool overflow;
+
+  X86Emitter(unsigned char* c, size_t cap) : code(c), capacity(cap), pos(0), overflow(false) {}
+
+  void byte(unsigned char b) {
+    if (pos < capacity) code[pos] = b;
+    else overflow = true;
+    pos++;
+  }
+  void dword(int value) {
+    for (int i = 0; i < 4; i++) byte((value >> (i * 8)) & 0xFF);
+  }
+  void qword(uint64_t value) {
+    for (int i = 0; i < 8; i++) byte((value >> (i * 8)) & 0xFF);
+  }
+  void rex(bool w, int reg, int index, int base) {
+    unsigned char prefix = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+    if (prefix != 0x40) byte(prefix);
+  }
+  void modrm(int mod, int reg, int rm) {byte((mod << 6) | ((reg & 7) << 3) | (rm & 7));}
+  void memory(int reg, int base, int disp) {modrm(2, reg, base); dword(disp);} // [base + disp32], base is never rsp or r12
+
+  void alu(AluOperations op, int dst, int src) {rex(false, src, 0, dst); byte(op); modrm(3, src, dst);}
+  void aluImmediate(AluOperations op, int dst, int imm) {rex(false, 0, 0, dst); byte(0x81); modrm(3, immediateDigit(op), dst); dword(imm);}
+  void mov(int dst, int src) {if (dst != src) alu(ALU_MOV, dst, src);}
+  void movImmediate(int dst, int imm) {rex(false, 0, 0, dst); byte(0xB8 + (dst & 7)); dword(imm);}
+  void movImmediate64(int dst, uint64_t imm) {rex(true, 0, 0, dst); byte(0xB8 + (dst & 7)); qword(imm);}
+  void mov64(int dst, int src) {rex(true, src, 0, dst); byte(0x89); modrm(3, src, dst);}
+  void lea64(int dst, int base, int disp) {rex(true, dst, 0, base); byte(0x8D); memory(dst, base, disp);}
+  void imul(int dst, int src) {rex(false, dst, 0, src); byte(0x0F); byte(0xAF); modrm(3, dst, src);}
+  void shift(int digit, int dst, unsigned char count) {rex(false, 0, 0, dst); byte(0xC1); modrm(3, digit, dst); byte(count);}
+  void shl(int dst, unsigned char count) {shift(4, dst, count);}
+  void shr(int dst, unsigned char count) {shift(5, dst, count);}
+  void sar(int dst, unsigned char count) {shift(7, dst, count);}
+  void notRegister(int dst) {rex(false, 0, 0, dst); byte(0xF7); modrm(3, 2, dst);}
+  void neg(int dst) {rex(false, 0, 0, dst); byte(0xF7); modrm(3, 3, dst);}
+  void testImmediate(int dst, int imm) {rex(false, 0, 0, dst); byte(0xF7); modrm(3, 0, dst); dword(imm);}
+  void seteAL() {byte(0x0F); byte(0x94); byte(0xC0);}
+  void movzxEAXAL() {byte(0x0F); byte(0xB6); byte(0xC0);}
+
+  void load(int dst, int base, int disp) {rex(false, dst, 0, base); byte(0x8B); memory(dst, base, disp);}
+  void store(int base, int disp, int src) {rex(false, src, 0, base); byte(0x89); memory(src, base, disp);}
+  void storeImmediate(int base, int disp, int imm) {rex(false, 0, 0, base); byte(0xC7); memory(0, base, disp); dword(imm);}
+  void cmpMemory(int reg, int base, int disp) {rex(false, reg, 0, base); byte(0x3B); memory(reg, base, disp);}
+  void loadWord(int dst, int base, int disp) {rex(false, dst, 0, base); byte(0x0F); byte(0xB7); memory(dst, base, disp);}
+  void loadWordIndexed(int dst, int base, int index) { // movzx dst, word [base + index]
+    rex(false, dst, index, base); byte(0x0F); byte(0xB7);
+    modrm(1, dst, 4); byte(((index & 7) << 3) | (base & 7)); byte(0);
+  }
+  void storeWordIndexed(int base, int index, int src) { // mov word [base + index], src
+    byte(0x66); rex(false, src, index, base); byte(0x89);
+    modrm(1, src, 4); byte(((index & 7) << 3) | (base & 7)); byte(0);
+  }
+  void cmpByteIndexedZero(int base, int index, int disp) { // cmp byte [base + index + disp32], 0
+    rex(false, 0, index, base); byte(0x80);
+    modrm(2, 7, 4); byte(((index & 7) << 3) | (base & 7)); dword(disp); byte(0);
+  }
+
+  void push(int reg) {rex(false, 0, 0, reg); byte(0x50 + (reg & 7));}
+  void pop(int reg) {rex(false, 0, 0, reg); byte(0x58 + (reg & 7));}
+  void adjustStack(int amount) {byte(0x48); byte(0x83); byte(amount < 0 ? 0xEC : 0xC4); byte(amount < 0 ? -amount : amount);}
+  void callRAX() {byte(0xFF); byte(0xD0);}
+  void ret() {byte(0xC3);}
+  size_t jcc(unsigned char condition) {byte(0x0F); byte(0x80 + condition); dword(0); return pos - 4;}
+  size_t jmp() {byte(0xE9); dword(0); return pos - 4;}
+  void patch(size_t position, size_t target) {
+    int rel = (int)(target - (position + 4));
+    if (position + 4 <= capacity) memcpy(code + position, &rel, 4);
+  }
+};
+
+#define CONDITION_ABOVE_OR_EQUAL 0x3
+#define CONDITION_EQUAL 0x4
+#define CONDITION_NOT_EQUAL 0x5
+#define CONDITION_LESS_OR_EQUAL 0xE
+
+/* JitCompiler methods */
+JitCompiler::JitCompiler(Emulator* e) : emulator(e), capacity(CODE_BUFFER_SIZE), used(0), flushed(false) {
+  void* memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  buffer = (memory == MAP_FAILED) ? nullptr : (unsigned char*)memory;
+  memset(blocks, 0, sizeof(blocks));
+  memset(hotness, 0, sizeof(hotness));
+  memset(translatedByte, 0, sizeof(translatedByte));
+}
+
+JitCompiler::~JitCompiler() {
+  if (buffer != nullptr) munmap(buffer, capacity);
+}
+
+JitBlock JitCompiler::blockAt(int address) {
+  JitBlock block = blocks[address];
+  if (block != nullptr || hotness[address] == NEVER_TRANSLATE) return block;
+  if (++hotness[address] < HOT_THRESHOLD) return nullptr;
+  block = translate(address);
+  if (block == nullptr && flushed) block = translate(address); // buffer was full, try again in the emptied one
+  if (block == nullptr) hotness[address] = NEVER_TRANSLATE;
+  return block;
+}
+
+void JitCompiler::invalidate(int address) {
+  if (translatedByte[address] || translatedByte[address + 1]) flush();
+}
+
+void JitCompiler::flush() {
+  used = 0;
+  memset(blocks, 0, sizeof(blocks));
+  memset(hotness, 0, sizeof(hotness));
+  memset(translatedByte, 0, sizeof(translatedByte));
+  flushed = true;
+}
+
+// stores go through the emulator, the block leaves when it hit translated code or a device
+int JitCompiler::store(JitCompiler* jit, int address, int value) {
+  Emulator* emu = jit->emulator;
+  int adr = address & 0xFFFF;
+  jit->flushed = false;
+  emu->setMemoryValue(adr, value);
+  return jit->flushed || ((emu->pageAttributes[adr >> 8] | emu->pageAttributes[(adr + 1) >> 8]) & PAGE_DEVICE) != 0;
+}
+
+bool JitCompiler::canTranslate(const DecodedInstruction& instr) {
+  bool writable = instr.regDest <= 6; // pc and psw writes change the control flow or the interrupt mask
+  bool readable = instr.regDest <= 8;
+  bool sourceWritable = instr.regSrc <= 6;
+  bool sourceReadable = instr.regSrc <= 8;
+  bool sourceUpdatable = sourceWritable || (instr.update == UpdateModes::NO_UPDATE && sourceReadable);
+  switch (instr.opCode) {
+    case 0x60: return writable && sourceWritable;
+    case 0x70: case 0x71: case 0x72: return writable && sourceReadable;
+    case 0x74: case 0x84: return readable && sourceReadable;
+    case 0x80: return writable;
+    case 0x81: case 0x82: case 0x83: return writable && sourceReadable;
+    case 0xA0:
+      if (!writable) return false;
+      switch (instr.addrMode) {
+        case AddressModes::IMMEDIATE: return true;
+        case AddressModes::REGISTER_DIRECT: return sourceReadable;
+        case AddressModes::REGISTER_INDIRECT: return sourceUpdatable;
+        case AddressModes::REGISTER_INDIRECT_OFFSET: return sourceUpdatable;
+        case AddressModes::MEMORY: return true;
+        case AddressModes::REGISTER_DIRECT_ADDITION: return sourceReadable;
+        default: return false;
+      }
+    case 0xB0:
+      if (!readable) return false;
+      switch (instr.addrMode) {
+        case AddressModes::REGISTER_DIRECT: return sourceWritable;
+        case AddressModes::REGISTER_INDIRECT: return sourceUpdatable;
+        case AddressModes::REGISTER_INDIRECT_OFFSET: return sourceUpdatable;
+        case AddressModes::MEMORY: return true;
+        case AddressModes::REGISTER_DIRECT_ADDITION: return sourceWritable;
+        default: return false;
+      }
+    default: // jumps, calls, interrupts, halt, division and shifts are left to the interpreter
+      return false;
+  }
+}
+
+// direct jumps end a block inside the translated code, their target is known at translation time
+bool JitCompiler::isDirectBranch(const DecodedInstruction& instr) {
+  return instr.opCode >= 0x50 && instr.opCode <= 0x53 &&
+    (instr.addrMode == AddressModes::IMMEDIATE || instr.addrMode == AddressModes::REGISTER_DIRECT_ADDITION);
+}
+
+void JitCompiler::emitBranch(X86Emitter& e, const DecodedInstruction& instr, int address, int count) {
+  int next = address + instr.length;
+  int target = instr.addrMode == AddressModes::IMMEDIATE ? instr.operand : ((next + instr.operand) & 0xFFFF);
+  switch (instr.opCode) {
+    case 0x50: // jmp
+      exits.push_back(JitExit(e.jmp(), target, count + 1));
+      return;
+    case 0x51: // jeq, taken when Z is set
+      e.testImmediate(R15, 1);
+      exits.push_back(JitExit(e.jcc(CONDITION_NOT_EQUAL), target, count + 1));
+      break;
+    case 0x52: // jne, taken when Z is clear
+      e.testImmediate(R15, 1);
+      exits.push_back(JitExit(e.jcc(CONDITION_EQUAL), target, count + 1));
+      break;
+    case 0x53: // jgt, taken when (Z | (N ^ O)) is clear
+      e.mov(RCX, R15); e.shr(RCX, 3);
+      e.mov(RDX, R15); e.shr(RDX, 1);
+      e.alu(ALU_XOR, RCX, RDX);
+      e.alu(ALU_OR, RCX, R15);
+      e.testImmediate(RCX, 1);
+      exits.push_back(JitExit(e.jcc(CONDITION_EQUAL), target, count + 1));
+      break;
+  }
+  exits.push_back(JitExit(e.jmp(), next, count + 1));
+}
+
+JitBlock JitCompiler::translate(int start) {
+  X86Emitter e(buffer + used, capacity - used);
+  Emulator* emu = emulator;
+  int pswOffset = (char*)&emu->psw - (char*)emu->r;
+  int memoryOffset = (char*)emu->memory - (char*)emu->r;
+
+  flushed = false;
+  exits.clear();
+
+  // prologue: keep the state pointer in rbx, guest memory in rbp and the guest registers in r8d..r15d
+  e.push(RBX); e.push(RBP); e.push(R12); e.push(R13); e.push(R14); e.push(R15);
+  e.adjustStack(-8);
+  e.mov64(RBX, RDI);
+  e.lea64(RBP, RBX, memoryOffset);
+  for (int i = 0; i < 7; i++) e.load(hostRegister[i], RBX, i * 4);
+  e.load(R15, RBX, pswOffset);
+
+  int address = start;
+  int count = 0;
+  bool branched = false;
+  while (count < MAX_BLOCK_INSTRUCTIONS && !branched) {
+    DecodedInstruction& instr = emu->decodeCache[address].valid ? emu->decodeCache[address] : emu->decode(address);
+    if (address + instr.length > 0xFFFF) break;
+    if (isDirectBranch(instr)) {
+      emitBranch(e, instr, address, count);
+      branched = true;
+    }
+    else if (canTranslate(instr)) emitInstruction(e, instr, address, count);
+    else break;
+    for (int i = address; i < address + instr.length; i++) translatedByte[i] = true;
+    address += instr.length;
+    count++;
+  }
+  if (count == 0) return nullptr;
+
+  if (!branched) exits.push_back(JitExit(e.jmp(), address, count));
+  size_t epilogue = e.pos;
+  for (int i = 0; i < 7; i++) e.store(RBX, i * 4, hostRegister[i]);
+  e.store(RBX, pswOffset, R15);
+  e.adjustStack(8);
+  e.pop(R15); e.pop(R14); e.pop(R13); e.pop(R12); e.pop(RBP); e.pop(RBX);
+  e.ret();
+  for (JitExit& exit: exits) {
+    e.patch(exit.patchPosition, e.pos);
+    e.storeImmediate(RBX, 7 * 4, exit.pc);
+    e.movImmediate(RAX, exit.count);
+    e.patch(e.jmp(), epilogue);
+  }
+
+  if (e.overflow) {
+    flush();
+    return nullptr;
+  }
+  JitBlock block = (JitBlock)(buffer + used);
+  used += (e.pos + 15) & ~15;
+  blocks[start] = block;
+  return block;
+}
+
+void JitCompiler::emitLoadRegister(X86Emitter& e, int host, int guest, int nextPc) {
+  if (guest == 7) e.movImmediate(host, nextPc);
+  else e.mov(host, hostRegister[guest]);
+}
+
+// value in edx is stored to the address in ecx, eax is left nonzero when the block has to leave
+void JitCompiler::emitStore(X86Emitter& e) {
+  int pswOffset = (char*)&emulator->psw - (char*)emulator->r;
+  int pageAttributesOffset = (char*)emulator->pageAttributes - (char*)emulator->r;
+  vector<size_t> slowPath;
+
+  // plain ram is written in place, pages with any attribute go through the emulator
+  e.aluImmediate(ALU_AND, RCX, 0xFFFF);
+  e.mov(RAX, RCX); e.shr(RAX, 8);
+  e.cmpByteIndexedZero(RBX, RAX, pageAttributesOffset);
+  slowPath.push_back(e.jcc(CONDITION_NOT_EQUAL));
+  e.mov(RAX, RCX); e.aluImmediate(ALU_ADD, RAX, 1); e.shr(RAX, 8);
+  e.cmpByteIndexedZero(RBX, RAX, pageAttributesOffset);
+  slowPath.push_back(e.jcc(CONDITION_NOT_EQUAL));
+  e.storeWordIndexed(RBP, RCX, RDX);
+  e.alu(ALU_XOR, RAX, RAX);
+  size_t done = e.jmp();
+
+  for (size_t position: slowPath) e.patch(position, e.pos);
+  for (int i = 0; i < 7; i++) e.store(RBX, i * 4, hostRegister[i]);
+  e.store(RBX, pswOffset, R15);
+  e.mov(RSI, RCX);
+  e.movImmediate64(RDI, (uint64_t)this);
+  e.movImmediate64(RAX, (uint64_t)&JitCompiler::store);
+  e.callRAX();
+  for (int i = 0; i < 4; i++) e.load(hostRegister[i], RBX, i * 4); // r8d..r11d are caller saved
+  e.patch(done, e.pos);
+}
+
+void updateRegister(X86Emitter& e, int host, int update, bool before) {
+  if (before && update == UpdateModes::PRE_DECREMENT) e.aluImmediate(ALU_SUB, host, 2);
+  if (before && update == UpdateModes::PRE_INCREMENT) e.aluImmediate(ALU_ADD, host, 2);
+  if (!before && update == UpdateModes::POST_DECREMENT) e.aluImmediate(ALU_SUB, host, 2);
+  if (!before && update == UpdateModes::POST_INCREMENT) e.aluImmediate(ALU_ADD, host, 2);
+}
+
+void JitCompiler::emitInstruction(X86Emitter& e, const DecodedInstruction& instr, int address, int count) {
+  int next = address + instr.length;
+  int dst = instr.regDest <= 8 ? hostRegister[instr.regDest] : -1;
+  int src = instr.regSrc <= 8 ? hostRegister[instr.regSrc] : -1;
+  bool pop = instr.addrMode == AddressModes::REGISTER_INDIRECT && instr.update == UpdateModes::POST_INCREMENT && instr.regSrc == 6;
+  bool push = instr.addrMode == AddressModes::REGISTER_INDIRECT && instr.update == UpdateModes::PRE_DECREMENT && instr.regSrc == 6;
+
+  switch (instr.opCode) {
+    case 0x60: // xchg
+      e.mov(RAX, dst);
+      e.mov(dst, src);
+      e.aluImmediate(ALU_AND, RAX, 0xFFFF);
+      e.mov(src, RAX);
+      break;
+    case 0x70: case 0x71: case 0x72: // add, sub, mul
+      emitLoadRegister(e, RCX, instr.regSrc, next);
+      if (instr.opCode == 0x70) e.alu(ALU_ADD, dst, RCX);
+      else if (instr.opCode == 0x71) e.alu(ALU_SUB, dst, RCX);
+      else e.imul(dst, RCX);
+      e.aluImmediate(ALU_AND, dst, 0xFFFF);
+      break;
+    case 0x74: // cmp, psw = (psw & 0xFFF0) | Z | O << 1 | C << 2 | N << 3
+      emitLoadRegister(e, RAX, instr.regDest, next);
+      emitLoadRegister(e, RCX, instr.regSrc, next);
+      e.mov(RDX, RAX); e.alu(ALU_SUB, RDX, RCX);
+      e.mov(RSI, RAX); e.alu(ALU_XOR, RSI, RCX);
+      e.mov(RDI, RAX); e.alu(ALU_XOR, RDI, RDX);
+      e.alu(ALU_AND, RSI, RDI); e.shr(RSI, 14); e.aluImmediate(ALU_AND, RSI, 2);
+      e.mov(RDI, RDX); e.shr(RDI, 12); e.aluImmediate(ALU_AND, RDI, 8); e.alu(ALU_OR, RSI, RDI);
+      e.mov(RDI, RDX); e.sar(RDI, 16); e.neg(RDI); e.alu(ALU_SBB, RDI, RDI); e.aluImmediate(ALU_AND, RDI, 4); e.alu(ALU_OR, RSI, RDI);
+      e.alu(ALU_TEST, RDX, RDX); e.seteAL(); e.movzxEAXAL(); e.alu(ALU_OR, RSI, RAX);
+      e.aluImmediate(ALU_AND, R15, 0xFFF0);
+      e.alu(ALU_OR, R15, RSI);
+      break;
+    case 0x84: // test, psw = (psw & 0xFFF6) | Z | N << 3
+      emitLoadRegister(e, RDX, instr.regDest, next);
+      emitLoadRegister(e, RCX, instr.regSrc, next);
+      e.alu(ALU_AND, RDX, RCX);
+      e.mov(RSI, RDX); e.shr(RSI, 12); e.aluImmediate(ALU_AND, RSI, 8);
+      e.alu(ALU_TEST, RDX, RDX); e.seteAL(); e.movzxEAXAL(); e.alu(ALU_OR, RSI, RAX);
+      e.aluImmediate(ALU_AND, R15, 0xFFF6);
+      e.alu(ALU_OR, R15, RSI);
+      break;
+    case 0x80: // not
+      e.notRegister(dst);
+      break;
+    case 0x81: case 0x82: case 0x83: // and, or, xor
+      emitLoadRegister(e, RCX, instr.regSrc, next);
+      e.alu(instr.opCode == 0x81 ? ALU_AND : (instr.opCode == 0x82 ? ALU_OR : ALU_XOR), dst, RCX);
+      break;
+    case 0xA0: // ldr
+      switch (instr.addrMode) {
+        case AddressModes::IMMEDIATE:
+          e.movImmediate(dst, instr.operand);
+          break;
+        case AddressModes::REGISTER_DIRECT:
+          emitLoadRegister(e, dst, instr.regSrc, next);
+          break;
+        case AddressModes::REGISTER_INDIRECT:
+        case AddressModes::REGISTER_INDIRECT_OFFSET:
+          if (pop) {
+            e.mov(RCX, R14); e.aluImmediate(ALU_AND, RCX, 0xFFFF);
+            e.loadWordIndexed(dst, RBP, RCX);
+            e.aluImmediate(ALU_ADD, R14, 2);
+            break;
+          }
+          if (src != -1) updateRegister(e, src, instr.update, true);
+          emitLoadRegister(e, RCX, instr.regSrc, next);
+          if (instr.addrMode == AddressModes::REGISTER_INDIRECT_OFFSET) e.aluImmediate(ALU_ADD, RCX, instr.operand);
+          e.aluImmediate(ALU_AND, RCX, 0xFFFF);
+          e.loadWordIndexed(dst, RBP, RCX);
+          if (src != -1) updateRegister(e, src, instr.update, false);
+          break;
+        case AddressModes::MEMORY:
+          e.loadWord(dst, RBP, instr.operand & 0xFFFF);
+          break;
+        case AddressModes::REGISTER_DIRECT_ADDITION:
+          emitLoadRegister(e, RAX, instr.regSrc, next);
+          e.aluImmediate(ALU_ADD, RAX, instr.operand);
+          e.aluImmediate(ALU_AND, RAX, 0xFFFF);
+          e.mov(dst, RAX);
+          break;
+      }
+      break;
+    case 0xB0: // str
+      switch (instr.addrMode) {
+        case AddressModes::REGISTER_DIRECT:
+          emitLoadRegister(e, src, instr.regDest, next);
+          break;
+        case AddressModes::REGISTER_INDIRECT:
+        case AddressModes::REGISTER_INDIRECT_OFFSET:
+          if (push) { // the interpreter executes the push again and reports the stack overflow
+            e.mov(RAX, R14); e.aluImmediate(ALU_SUB, RAX, 2);
+            e.cmpMemory(RAX, RBX, (char*)&emulator->maxAddress - (char*)emulator->r);
+            exits.push_back(JitExit(e.jcc(CONDITION_LESS_OR_EQUAL), address, count));
+            e.mov(R14, RAX);
+            emitLoadRegister(e, RDX, instr.regDest, next);
+            e.mov(RCX, R14);
+            emitStore(e);
+          } else {
+            if (src != -1) updateRegister(e, src, instr.update, true);
+            emitLoadRegister(e, RCX, instr.regSrc, next);
+            if (instr.addrMode == AddressModes::REGISTER_INDIRECT_OFFSET) e.aluImmediate(ALU_ADD, RCX, instr.operand);
+            emitLoadRegister(e, RDX, instr.regDest, next);
+            emitStore(e);
+            if (src != -1) updateRegister(e, src, instr.update, false);
+          }
+          e.alu(ALU_TEST, RAX, RAX);
+          exits.push_back(JitExit(e.jcc(CONDITION_NOT_EQUAL), next, count + 1));
+          break;
+        case AddressModes::MEMORY:
+          e.movImmediate(RCX, instr.operand);
+          emitLoadRegister(e, RDX, instr.regDest, next);
+          emitStore(e);
+          e.alu(ALU_TEST, RAX, RAX);
+          exits.push_back(JitExit(e.jcc(CONDITION_NOT_EQUAL), next, count + 1));
+          break;
+        case AddressModes::REGISTER_DIRECT_ADDITION:
+          emitLoadRegister(e, RAX, instr.regDest, next);
+          e.aluImmediate(ALU_ADD, RAX, instr.operand);
+          e.aluImmediate(ALU_AND, RAX, 0xFFFF);
+          e.mov(src, RAX);
+          break;
+      }
+      break;
+  }
+}
+
+#else
+/* other hosts have no translator, the emulator stays with the interpreter */
+JitCompiler::JitCompiler(Emulator* e) : emulator(e), buffer(nullptr), capacity(0), used(0), flushed(false) {}
+JitCompiler::~JitCompiler() {}
+JitBlock JitCompiler::blockAt(int address) {return nullptr;}
+void JitCompiler::invalidate(int address) {}
+void JitCompiler::flush() {}
+#endif
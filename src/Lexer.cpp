@@ -0,0 +1,134 @@
+#include "../inc/Lexer.hpp"
+#include "../inc/Asembler.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+
+/* SourceFile */
+SourceFile::SourceFile(const string& name) : data(""), size(0), position(0) {
+  int descriptor = open(name.c_str(), O_RDONLY);
+  if (descriptor < 0) throw UnknownFileError(name.c_str());
+  struct stat status;
+  bool readable = fstat(descriptor, &status) == 0;
+  if (readable && status.st_size > 0) {
+    void* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    readable = mapping != MAP_FAILED;
+    if (readable) {
+      data = (const char*)mapping;
+      size = status.st_size;
+    }
+  }
+  close(descriptor);
+  if (!readable) throw UnknownFileError(name.c_str());
+}
+
+SourceFile::~SourceFile() {
+  if (size != 0) munmap((void*)data, size);
+}
+
+bool SourceFile::nextLine(string_view& line) {
+  if (position >= size) return false;
+  const char* end = (const char*)memchr(data + position, '\n', size - position);
+  size_t length = end ? end - (data + position) : size - position;
+  line = string_view(data + position, length);
+  position += length + 1;
+  return true;
+}
+
+/* keywords */
+static const int KEYWORD_TABLE_SIZE = 128;
+
+static const Keyword keywords[] = {
+  {"halt", KeywordKind::MNEMONIC, HALT}, {"int", KeywordKind::MNEMONIC, INT}, {"iret", KeywordKind::MNEMONIC, IRET},
+  {"call", KeywordKind::MNEMONIC, CALL}, {"ret", KeywordKind::MNEMONIC, RET}, {"jmp", KeywordKind::MNEMONIC, JMP},
+  {"jeq", KeywordKind::MNEMONIC, JEQ}, {"jne", KeywordKind::MNEMONIC, JNE}, {"jgt", KeywordKind::MNEMONIC, JGT},
+  {"push", KeywordKind::MNEMONIC, PUSH}, {"pop", KeywordKind::MNEMONIC, POP}, {"xchg", KeywordKind::MNEMONIC, XCHG},
+  {"add", KeywordKind::MNEMONIC, ADD}, {"sub", KeywordKind::MNEMONIC, SUB}, {"mul", KeywordKind::MNEMONIC, MUL},
+  {"div", KeywordKind::MNEMONIC, DIV}, {"cmp", KeywordKind::MNEMONIC, CMP}, {"not", KeywordKind::MNEMONIC, NOT},
+  {"and", KeywordKind::MNEMONIC, AND}, {"or", KeywordKind::MNEMONIC, OR}, {"xor", KeywordKind::MNEMONIC, XOR},
+  {"test", KeywordKind::MNEMONIC, TEST}, {"shl", KeywordKind::MNEMONIC, SHL}, {"shr", KeywordKind::MNEMONIC, SHR},
+  {"ldr", KeywordKind::MNEMONIC, LDR}, {"str", KeywordKind::MNEMONIC, STR},
+  {"global", KeywordKind::DIRECTIVE, GLOBAL}, {"extern", KeywordKind::DIRECTIVE, EXTERN},
+  {"section", KeywordKind::DIRECTIVE, SECTION}, {"word", KeywordKind::DIRECTIVE, WORD},
+  {"skip", KeywordKind::DIRECTIVE, SKIP}, {"ascii", KeywordKind::DIRECTIVE, ASCII}, {"end", KeywordKind::DIRECTIVE, END},
+  {"r0", KeywordKind::REGISTER, 0}, {"r1", KeywordKind::REGISTER, 1}, {"r2", KeywordKind::REGISTER, 2},
+  {"r3", KeywordKind::REGISTER, 3}, {"r4", KeywordKind::REGISTER, 4}, {"r5", KeywordKind::REGISTER, 5},
+  {"r6", KeywordKind::REGISTER, 6}, {"r7", KeywordKind::REGISTER, 7},
+  {"sp", KeywordKind::REGISTER, 6}, {"pc", KeywordKind::REGISTER, 7}, {"psw", KeywordKind::REGISTER, 8}
+};
+
+static const Keyword noKeyword = {"", KeywordKind::NONE, 0};
+
+// the multipliers were searched for so that no two keywords share a slot
+static unsigned keywordHash(string_view word) {
+  return ((unsigned char)word[0] * 3 + (unsigned char)word[1] * 24 + (unsigned char)word.back() * 38 + word.size()) % KEYWORD_TABLE_SIZE;
+}
+
+static const Keyword** buildKeywordTable() {
+  static const Keyword* table[KEYWORD_TABLE_SIZE] = {nullptr};
+  for (const Keyword& keyword: keywords) table[keywordHash(keyword.name)] = &keyword;
+  return table;
+}
+
+static const Keyword** keywordTable = buildKeywordTable();
+
+const Keyword& lookupKeyword(string_view word) {
+  if (word.size() < 2 || word.size() > 7) return noKeyword;
+  const Keyword* keyword = keywordTable[keywordHash(word)];
+  return keyword != nullptr && keyword->name == word ? *keyword : noKeyword;
+}
+
+static bool isWordCharacter(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool isHexDigit(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool isLiteral(string_view word) {
+  if (word.size() > 2 && word[0] == '0' && word[1] == 'x') {
+    for (size_t i = 2; i < word.size(); i++) if (!isHexDigit(word[i])) return false;
+    return true;
+  }
+  for (char c: word) if (c < '0' || c > '9') return false;
+  return !word.empty();
+}
+
+/* Lexer */
+static bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// only whitespace and an optional comment from position to the end of the line
+static bool restIsBlank(string_view line, size_t position) {
+  while (position < line.size() && isSpace(line[position])) position++;
+  return position == line.size() || line[position] == '#';
+}
+
+Token Lexer::scan() {
+  while (position < line.size() && isSpace(line[position])) position++;
+  if (position == line.size() || line[position] == '#') return Token{TokenKind::END, string_view()};
+
+  size_t start = position;
+  char c = line[position];
+  if (isWordCharacter(c)) {
+    while (position < line.size() && isWordCharacter(line[position])) position++;
+    return Token{TokenKind::WORD, line.substr(start, position - start)};
+  }
+  if (c == '"') { // the string runs to the last quote that only has a comment after it
+    for (size_t close = line.size(); close-- > start + 1; ) {
+      if (line[close] == '"' && restIsBlank(line, close + 1)) {
+        position = close + 1;
+        return Token{TokenKind::STRING, line.substr(start + 1, close - start - 1)};
+      }
+    }
+    position = line.size();
+    return Token{TokenKind::INVALID, line.substr(start)};
+  }
+  position++;
+  if (c != '\0' && strchr(".:,$%*[]+", c) != nullptr) return Token{TokenKind::PUNCTUATION, line.substr(start, 1)};
+  return Token{TokenKind::INVALID, line.substr(start, 1)};
+}
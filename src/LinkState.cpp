@@ -0,0 +1,219 @@
+#include "../inc/LinkState.hpp"
+#include <sys/stat.h>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+
+// FNV-1a
+uint64_t hashBytes(const unsigned char* data, size_t size, uint64_t hash) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t hashText(std::string_view text, uint64_t hash) {
+  const unsigned char terminator = 0;
+  return hashBytes(&terminator, 1, hashBytes((const unsigned char*)text.data(), text.size(), hash));
+}
+
+uint64_t hashNumber(int64_t number, uint64_t hash) {
+  unsigned char bytes[8];
+  for (int i = 0; i < 8; i++) bytes[i] = ((uint64_t)number >> (i * 8)) & 0xFF;
+  return hashBytes(bytes, 8, hash);
+}
+
+bool statFile(const std::string& name, LinkStateInput& input) {
+  struct stat status;
+  if (stat(name.c_str(), &status) != 0) return false;
+  input.name = name;
+  input.size = status.st_size;
+  input.modified = (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+  return true;
+}
+
+bool hashFile(const std::string& name, uint64_t& hash) {
+  std::ifstream file(name, std::ios::binary);
+  if (!file) return false;
+  hash = LINK_STATE_HASH_BASIS;
+  std::vector<unsigned char> buffer(1 << 16);
+  while (file) {
+    file.read((char*)buffer.data(), buffer.size());
+    hash = hashBytes(buffer.data(), file.gcount(), hash);
+  }
+  return true;
+}
+
+/* fields */
+static void put32(std::vector<unsigned char>& out, uint32_t value) {
+  out.resize(out.size() + 4);
+  writeImage32(&out[out.size() - 4], value);
+}
+
+static void put64(std::vector<unsigned char>& out, uint64_t value) {
+  put32(out, value & 0xFFFFFFFF);
+  put32(out, value >> 32);
+}
+
+static void putString(std::vector<unsigned char>& out, const std::string& text) {
+  put32(out, text.size());
+  out.insert(out.end(), text.begin(), text.end());
+}
+
+// every read checks what is left, a short or damaged state only makes the link start over
+struct StateReader{
+  const std::vector<unsigned char>& in;
+  size_t position;
+  bool valid;
+
+  bool has(uint64_t count) {
+    valid = valid && count <= in.size() - position;
+    return valid;
+  }
+  uint32_t get32() {
+    if (!has(4)) return 0;
+    position += 4;
+    return readImage32(&in[position - 4]);
+  }
+  uint64_t get64() {
+    uint64_t low = get32();
+    return low | ((uint64_t)get32() << 32);
+  }
+  std::string getString() {
+    uint32_t size = get32();
+    if (!has(size)) return "";
+    position += size;
+    return std::string((const char*)&in[position - size], size);
+  }
+  // a count of entries of at least the given size, so that a damaged count cannot ask for a huge vector
+  uint32_t getCount(uint32_t entrySize) {
+    uint32_t count = get32();
+    return has((uint64_t)count * entrySize) ? count : 0;
+  }
+};
+
+bool readLinkState(const std::string& name, LinkState& state) {
+  std::ifstream file(name, std::ios::binary);
+  if (!file) return false;
+  std::vector<unsigned char> in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  // the hash of everything before it closes the state, a damaged image would otherwise go out as it is
+  if (in.size() < 16 || memcmp(in.data(), LINK_STATE_MAGIC, 4) != 0 || readImage32(&in[4]) != LINK_STATE_VERSION) return false;
+  uint64_t hash = readImage32(&in[in.size() - 8]) | ((uint64_t)readImage32(&in[in.size() - 4]) << 32);
+  if (hash != hashBytes(in.data(), in.size() - 8)) return false;
+  in.resize(in.size() - 8);
+  StateReader r{in, 8, true};
+
+  state.options = r.getString();
+  state.inputs.resize(r.getCount(28));
+  for (LinkStateInput& input: state.inputs) {
+    input.name = r.getString();
+    input.size = r.get64();
+    input.modified = r.get64();
+    input.hash = r.get64();
+  }
+  state.objects.resize(r.getCount(24));
+  for (LinkStateObject& object: state.objects) {
+    object.name = r.getString();
+    object.input = r.get32();
+    object.shape = r.get64();
+    object.pieces.resize(r.getCount(8));
+    for (LinkStatePiece& piece: object.pieces) {
+      piece.address = r.get32();
+      piece.size = r.get32();
+    }
+    object.sites.resize(r.getCount(8));
+    for (LinkStateSite& site: object.sites) {
+      site.address = r.get32();
+      site.symbol = r.get32();
+    }
+    object.origins.resize(r.getCount(8));
+    for (LinkStateOrigin& origin: object.origins) {
+      origin.symbol = r.get32();
+      origin.base = r.get32();
+    }
+  }
+  state.sections.resize(r.getCount(12));
+  for (LinkStateSection& section: state.sections) {
+    section.name = r.getString();
+    section.startAddress = r.get32();
+    section.size = r.get32();
+  }
+  state.symbols.resize(r.getCount(12));
+  for (LinkStateSymbol& symbol: state.symbols) {
+    symbol.name = r.getString();
+    symbol.value = r.get32();
+    symbol.size = r.get32();
+  }
+  state.code.resize(r.getCount(1));
+  if (!state.code.empty()) memcpy(state.code.data(), &in[r.position], state.code.size());
+  r.position += state.code.size();
+  state.used.resize(r.getCount(8));
+  for (uint64_t& word: state.used) word = r.get64();
+
+  // references between the tables, the image is checked by the linker against the sections
+  for (size_t i = 1; r.valid && i < state.symbols.size(); i++) r.valid = state.symbols[i - 1].name < state.symbols[i].name;
+  for (size_t i = 0; r.valid && i < state.objects.size(); i++) {
+    const LinkStateObject& object = state.objects[i];
+    r.valid = object.input < state.inputs.size();
+    for (const LinkStatePiece& piece: object.pieces) r.valid = r.valid && (uint64_t)piece.address + piece.size <= state.code.size();
+    for (const LinkStateSite& site: object.sites)
+      r.valid = r.valid && (uint64_t)site.address + 2 <= state.code.size() && site.symbol < state.symbols.size();
+    for (const LinkStateOrigin& origin: object.origins) r.valid = r.valid && origin.symbol < state.symbols.size();
+  }
+  return r.valid && r.position == in.size() && state.used.size() * 64 == state.code.size();
+}
+
+void writeLinkState(const std::string& name, const LinkState& state) {
+  std::vector<unsigned char> out(LINK_STATE_MAGIC, LINK_STATE_MAGIC + 4);
+  put32(out, LINK_STATE_VERSION);
+  putString(out, state.options);
+  put32(out, state.inputs.size());
+  for (const LinkStateInput& input: state.inputs) {
+    putString(out, input.name);
+    put64(out, input.size);
+    put64(out, input.modified);
+    put64(out, input.hash);
+  }
+  put32(out, state.objects.size());
+  for (const LinkStateObject& object: state.objects) {
+    putString(out, object.name);
+    put32(out, object.input);
+    put64(out, object.shape);
+    put32(out, object.pieces.size());
+    for (const LinkStatePiece& piece: object.pieces) {
+      put32(out, piece.address);
+      put32(out, piece.size);
+    }
+    put32(out, object.sites.size());
+    for (const LinkStateSite& site: object.sites) {
+      put32(out, site.address);
+      put32(out, site.symbol);
+    }
+    put32(out, object.origins.size());
+    for (const LinkStateOrigin& origin: object.origins) {
+      put32(out, origin.symbol);
+      put32(out, origin.base);
+    }
+  }
+  put32(out, state.sections.size());
+  for (const LinkStateSection& section: state.sections) {
+    putString(out, section.name);
+    put32(out, section.startAddress);
+    put32(out, section.size);
+  }
+  put32(out, state.symbols.size());
+  for (const LinkStateSymbol& symbol: state.symbols) {
+    putString(out, symbol.name);
+    put32(out, symbol.value);
+    put32(out, symbol.size);
+  }
+  put32(out, state.code.size());
+  out.insert(out.end(), state.code.begin(), state.code.end());
+  put32(out, state.used.size());
+  for (uint64_t word: state.used) put64(out, word);
+  put64(out, hashBytes(out.data(), out.size()));
+
+  std::ofstream file(name, std::ios::binary);
+  file.write((const char*)out.data(), out.size());
+}
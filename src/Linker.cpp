@@ -1,11 +1,17 @@
 #include "../inc/Linker.hpp"
+#include "../inc/HexCodec.hpp"
 #include <fstream>
 #include <algorithm>
 #include <sstream>
 #include <unordered_map>
 #include <iomanip>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
 
 unordered_map<string, int> placeOptionMap;
+vector<string> keepOptions; // sections -gc-sections keeps whether they are referenced or not
+vector<string> mergeOptions; // sections whose equal constants are kept once
 
 
 /* friend/helper functions */
@@ -25,185 +31,510 @@ vector<string> commaSeparatedListToVector(string list) {
   return vec;
 }
 
-vector<unsigned char> parseSectionCode(string sectionCode) {
-  stringstream sstr(sectionCode);
-  vector<unsigned char> vec;
-  string substr;
-  while (sstr.good()) {
-    getline(sstr, substr, ':');
-    if (!substr.empty())
-      vec.push_back((unsigned char)stoi(substr, nullptr, 16));
-  }
-  return vec;
-}
-
 /* Linker methods */
-Linker::Linker(vector<string> i, bool hex, bool rel, string o) {
-  if (hex == rel) throw InvalidCmdArgs();
+Linker::Linker(vector<string> i, bool hex, bool rel, string o, bool bin, int j, bool inc, bool ver, bool gc, bool icf) {
+  if (hex == rel || (rel && (inc || gc || icf || !mergeOptions.empty()))) throw InvalidCmdArgs();
   input = i;
   output = o;
   this->hex = hex;
   this->relocatable = rel;
+  this->binary = bin;
+  this->jobs = j;
+  this->incremental = inc;
+  this->verify = ver;
+  this->gcSections = gc;
+  this->icf = icf;
 }
 
-void Linker::link() {
-  ifstream ulaz;
-  string line;
-
-  for (string x : input) { // parsing symbol tables
-    ulaz = ifstream(x);
-    if (!ulaz.is_open())
-      throw UnknownFileError(x.c_str());
-    getline(ulaz, line); //"UND" section
-    while (getline(ulaz, line)) {
-      if (line == "end symbol table")
-        break;
-      parseSymbol(line);
+static bool isArchiveName(const string& name) {
+  return name.size() > 2 && name.compare(name.size() - 2, 2, ".a") == 0;
+}
+
+// every input is read once, the sections then refer to the objects' bytes and relocations in place
+void Linker::loadObjects() {
+  for (size_t i = 0; i < input.size(); i++) {
+    if (isArchiveName(input[i])) {
+      archiveNames.push_back(input[i]);
+      archiveSources.push_back(i);
     }
-    resolveSymbols(x);
-    ulaz.close();
+    else objects.emplace_back(input[i], i);
   }
+  readInputs(0);
+  resolveInputs(0);
+  loadArchiveMembers();
 
   if (this->hex) checkForUndefinedSymbols();
 
-  for (string x : input) {
-    ulaz = ifstream(x);
-    if (!ulaz.is_open())
-      throw UnknownFileError(x.c_str());
-    while (getline(ulaz, line)) { // getting to sections
-      if (line == "end symbol table")
-        break;
-    }
-
-    while (getline(ulaz, line)) { //"new section" or "end file"
-      if (line == "end file")
-        break;
-      getline(ulaz, line); // section name
-      string secName = line;
-      getline(ulaz, line); // section code
-      vector<unsigned char> c = parseSectionCode(line);
-      int ind;
-      
-      if ((ind = getSectionIndex(secName)) == -1)
-        sections.push_back(Section(secName, c));
-      else {
-        Symbol* thisSection = symbolTable.getSymbolByKey(secName);
-        for(auto& sym: symbolTable.table) {
-          if (sym.second->name != secName && sym.second->sectionNumber == thisSection->sectionNumber &&
-          sym.second->originFile == x) sym.second->value += sections[ind].code.size();
-        }
-        sections[ind].code.insert(sections[ind].code.end(), c.begin(), c.end());
-        sections[ind].sectionOccurence++;
-      }
+  indexFileSymbols();
+  if (gcSections) collectGarbage();
+  if (icf) foldIdenticalSections();
+  for (size_t i = 0; i < objects.size(); i++) readSections(i);
+  if (!foldedPieces.empty()) redirectFoldedSymbols();
+}
 
-      getline(ulaz, line); // "rel entries" or "end section"
-      if (line == "rel entries") {
-        ind = getSectionIndex(secName);
-        while (getline(ulaz, line)) {
-          if (line == "end rel entries")
-            break;
-          parseRelocationEntry(line, ind, sections[ind].code.size() - c.size());
-        }
-        getline(ulaz, line); // to get "end section"
-      }
-    }
-    ulaz.close();
-  }
-  
-  // check when relocatable==true
+void Linker::buildImage() {
+  loadObjects();
   if (!placeOptionMap.empty()) {
     placeSections();
     checkForOverlappingSections();
   }
   packCode();
-  updateSymbolAndRelocationEntryValues();
+  updateSymbolValues();
   resolveRelocationEntries();
+}
+
+// with -incremental the output's state is patched when it can be, a full link replaces it otherwise
+void Linker::link() {
+  if (this->relocatable) { // sections stay where they are in the merged object and relocations stay unresolved
+    loadObjects();
+    ofstream izlaz(this->output, ios::binary);
+    formRelocatableOutput(izlaz);
+    izlaz.close();
+    return;
+  }
 
-  ofstream izlaz(this->output);
-  if (this->hex)
-    formHexOutput(izlaz);
+  bool patched = incremental && relinkIncrementally();
+  if (!patched) buildImage();
+  string result = formOutput();
+  if (patched && verify) {
+    Linker clean(input, true, false, output, binary, jobs, false, false, gcSections, icf);
+    clean.buildImage();
+    if (clean.formOutput() != result) {
+      remove(stateName().c_str());
+      throw IncrementalLinkError();
+    }
+  }
+
+  ofstream izlaz(this->output, ios::binary);
+  izlaz << result;
   izlaz.close();
+  if (incremental) {
+    if (patched || collectLinkState()) {
+      state.code.swap(generatedCode);
+      state.used.swap(usedAddresses);
+      writeLinkState(stateName(), state);
+    }
+    else remove(stateName().c_str());
+  }
 }
 
 bool Linker::sectionExists(string name) {
   return (getSectionIndex(name) != -1);
 }
-int Linker::getSectionIndex(string name) {
-  for (int i = 0; i < sections.size(); i++) {
-    if (sections[i].name == name)
-      return i;
+int Linker::getSectionIndex(string_view name) {
+  auto section = sectionIndexes.find(name);
+  return section == sectionIndexes.end() ? -1 : section->second;
+}
+
+// lists a file's symbols the way a symbol table of its own would hold them, a repeated name keeps its first symbol
+static void indexSymbols(InputObject& input) {
+  const ObjectFile& object = *input.object;
+  unordered_set<string_view> names;
+  for (uint32_t i = 0; i < object.symbolCount(); i++) {
+    ObjectSymbol symbol = object.symbol(i);
+    if (symbol.number == 0 || !names.insert(object.string(symbol.name)).second) continue; // "UND"
+    input.symbols.push_back(i);
+    input.symbolNumbers[symbol.number] = i;
   }
-  return -1;
+  sort(input.symbols.begin(), input.symbols.end(), [&object](uint32_t a, uint32_t b) {
+    return object.string(object.symbol(a).name) < object.string(object.symbol(b).name);
+  });
 }
 
-void Linker::parseSymbol(string line) {
-  stringstream sstr(line);
-  string data;
-  Symbol symbol;
+// the pool threads take the next unread input until none are left, errors wait in the input for resolution
+void Linker::readInputs(size_t first) {
+  atomic<size_t> next(first);
+  auto worker = [&]() {
+    for (size_t i = next++; i < objects.size(); i = next++) {
+      try {
+        InputObject& object = objects[i];
+        if (object.member != nullptr) object.object.reset(new ObjectFile(object.member, object.memberSize));
+        else object.object.reset(new ObjectFile(object.name));
+        indexSymbols(object);
+      } catch (...) {
+        objects[i].error = current_exception();
+      }
+    }
+  };
+  vector<thread> pool;
+  for (size_t i = first + 1; i < first + (size_t)jobs && i < objects.size(); i++) pool.emplace_back(worker);
+  worker();
+  for (thread& t: pool) t.join();
+}
+
+// resolution depends on the input order, so it stays sequential
+void Linker::resolveInputs(size_t first) {
+  for (size_t i = first; i < objects.size(); i++) {
+    if (objects[i].error) rethrow_exception(objects[i].error);
+    resolveSymbols(objects[i], objects[i].name);
+  }
+}
+
+/* A member is only read once a symbol that is still extern is in an archive's index. Every round looks the
+ * extern symbols up in name order, the first archive on the command line that defines one wins, and the
+ * members it needs are read and resolved after everything before them. The symbols those members add are
+ * looked up in the next round, until a round needs no new member. An extern no archive defined stays so. */
+void Linker::loadArchiveMembers() {
+  for (const string& name: archiveNames) archives.emplace_back(new ArchiveFile(name));
+  vector<vector<bool>> loaded;
+  for (const unique_ptr<ArchiveFile>& archive: archives) loaded.emplace_back(archive->memberCount(), false);
 
-  getline(sstr, data, ':'); symbol.name = data;
-  getline(sstr, data, ':'); symbol.sectionNumber = stoi(data);
-  getline(sstr, data, ':'); symbol.value = stoi(data);
-  getline(sstr, data, ':'); symbol.isGlobal = ((data == "true") ? true : false);
-  getline(sstr, data, ':'); symbol.isExtern = ((data == "true") ? true : false);
-  getline(sstr, data, ':'); symbol.number = stoi(data);
-  getline(sstr, data, ':'); symbol.size = stoi(data);
+  size_t looked = 0; // symbols of the table that earlier rounds looked up
+  while (!archives.empty()) {
+    vector<Symbol*> externs;
+    for (auto symbol = symbolTable.begin() + looked; symbol != symbolTable.end(); symbol++) {
+      if (symbol->isOnlyExtern()) externs.push_back(&*symbol);
+    }
+    looked = symbolTable.size();
+    sort(externs.begin(), externs.end(), [](Symbol* a, Symbol* b) {return a->name < b->name;});
 
-  localSymbolTable.table.emplace(symbol.name, new Symbol(symbol));
+    size_t first = objects.size();
+    for (Symbol* symbol: externs) {
+      for (size_t a = 0; a < archives.size(); a++) {
+        int member = archives[a]->findSymbol(symbol->name);
+        if (member == -1) continue;
+        if (!loaded[a][member]) {
+          loaded[a][member] = true;
+          ArchiveMember entry = archives[a]->member(member);
+          objects.emplace_back(archiveNames[a] + "(" + string(archives[a]->string(entry.name)) + ")", archiveSources[a],
+            archives[a]->contents(entry), entry.size);
+        }
+        break;
+      }
+    }
+    if (objects.size() == first) break;
+    readInputs(first);
+    resolveInputs(first);
+  }
 }
 
-void Linker::resolveSymbols(string file) {
-  for(auto& x: localSymbolTable.table) {
-    Symbol* symbol = x.second;
-    Symbol *symbolFromTable = symbolTable.getSymbolByKey(symbol->name);
+// a global takes the number of its own section, which is only known once the whole file is in the table
+void Linker::resolveSymbols(const InputObject& input, string file) {
+  const ObjectFile& object = *input.object;
+  vector<pair<string_view, string_view>> definitions; // globals defined here and the names of their sections
+  for(uint32_t index: input.symbols) {
+    ObjectSymbol symbol = object.symbol(index);
+    string_view name = object.string(symbol.name);
+    bool isGlobal = symbol.flags & OBJECT_SYMBOL_GLOBAL, isExtern = symbol.flags & OBJECT_SYMBOL_EXTERN;
+    bool isSection = symbol.size != -1;
+    string_view sectionName;
+    if (!isSection && symbol.sectionNumber != 0) {
+      auto section = input.symbolNumbers.find(symbol.sectionNumber);
+      if (section == input.symbolNumbers.end()) throw InvalidObjectError();
+      sectionName = object.string(object.symbol(section->second).name);
+    }
+    Symbol *symbolFromTable = symbolTable.getSymbolByKey(name);
     if (symbolFromTable == nullptr) {
-      if (symbol->isExtern || symbol->isGlobal) { // no local symbols
-        symbolTable.table.emplace(symbol->name, new Symbol(symbol->name, symbol->value, symbol->isGlobal,
-        symbol->isExtern, symbol->size, symbol->isGlobal, file));
+      if (isExtern || isGlobal) { // no local symbols
+        symbolTable.addSymbol(name, symbol.value, isGlobal, isExtern, symbol.size, isGlobal, file);
+        if (isGlobal && !isSection) definitions.push_back({name, sectionName});
       }
     }
     else {
-      if (symbolFromTable->isOnlyExtern() && symbol->isOnlyGlobal()) { // extern symbolFromTable
+      if (symbolFromTable->isOnlyExtern() && !isExtern && isGlobal) { // extern symbolFromTable
         symbolFromTable->isExtern = false;
         symbolFromTable->isGlobal = true;
-        symbolFromTable->value = symbol->value;
-        symbolFromTable->sectionNumber = Symbol::currentSectionNumber;
-        symbolFromTable->originFile = file;
+        symbolFromTable->value = symbol.value;
+        symbolFromTable->originFile = symbolTable.intern(file);
+        definitions.push_back({name, sectionName});
       }
-      else if (symbolFromTable->isOnlyGlobal() && symbol->isOnlyGlobal()) { // both global
-        throw MultipleSymbolDefinitionError(symbol->name.c_str());
+      else if (symbolFromTable->isOnlyGlobal() && !isExtern && isGlobal) { // both global
+        throw MultipleSymbolDefinitionError(name.data());
       }
-      else if ((symbolFromTable->isSection() && !symbol->isSection()) || (!symbolFromTable->isSection() && symbol->isSection())) { // one is section the other is label
-        throw LabelSectionCollisionError(symbol->name.c_str());
+      else if (symbolFromTable->isSection() != isSection) { // one is section the other is label
+        throw LabelSectionCollisionError(name.data());
       } // else if (symbolFromTable->isOnlyGlobal() && symbol.isOnlyExtern()) <--- check this
     }
-    if (!symbol->isSection() && (symbol->isExtern || symbol->isGlobal) && symbol->sectionNumber != 0) {
-      helperSectionMap.insert({symbol->name, localSymbolTable.getSymbolByNumber(symbol->sectionNumber)->name});
+    if (!sectionName.empty() && (isExtern || isGlobal)) {
+      helperSectionMap.insert({string(name), string(sectionName)});
     }
   }
-  localSymbolTable.emptyTable();
+  for (auto& definition: definitions) { // a global without a section stays undefined
+    Symbol* section = definition.second.empty() ? nullptr : symbolTable.getSymbolByKey(definition.second);
+    symbolTable.getSymbolByKey(definition.first)->sectionNumber = section != nullptr ? section->sectionNumber : 0;
+  }
 }
 
 void Linker::checkForUndefinedSymbols() {
-  for(auto& x: symbolTable.table) {
-    Symbol* symbol = x.second;
+  for(Symbol* symbol: symbolTable.sortedByName()) {
     if ((symbol->isOnlyExtern() || symbol->sectionNumber == 0) && symbol->name != "UND") 
-      throw UnresolvedSymbolError(symbol->name.c_str());
+      throw UnresolvedSymbolError(symbol->name.data());
+  }
+}
+
+// symbols no longer change their file or section once they are resolved
+void Linker::indexFileSymbols() {
+  for (Symbol& sym: symbolTable) {
+    if (!sym.originFile.empty()) fileSymbols[sym.originFile][sym.sectionNumber].push_back(&sym);
+  }
+}
+
+int Linker::addSection(string_view name) {
+  int ind = getSectionIndex(name);
+  if (ind != -1) return ind;
+  sections.push_back(Section(string(name)));
+  sectionIndexes.emplace(name, sections.size() - 1);
+  return sections.size() - 1;
+}
+
+// a section seen before grows, the file's symbols in it move up by what was already there
+void Linker::appendSection(const ObjectFile& object, uint32_t index, const string& file) {
+  ObjectSection section = object.section(index);
+  string_view secName = object.string(section.name);
+  int ind = getSectionIndex(secName);
+  if (ind == -1) ind = addSection(secName);
+  else {
+    Symbol* thisSection = symbolTable.getSymbolByKey(secName);
+    auto symbols = fileSymbols.find(file);
+    if (thisSection != nullptr && symbols != fileSymbols.end()) {
+      auto inSection = symbols->second.find(thisSection->sectionNumber);
+      if (inSection != symbols->second.end()) {
+        for (Symbol* sym: inSection->second) {
+          if (sym->name != secName) sym->value += sections[ind].size;
+        }
+      }
+    }
+  }
+  sections[ind].pieces.push_back(SectionPiece{&object, section, index, sections[ind].size});
+  sections[ind].size += section.size;
+}
+
+// offset in the merged section of what was at the given offset of the object's section
+static int constantOffset(const vector<MergedConstant>& constants, int offset) {
+  auto constant = upper_bound(constants.begin(), constants.end(), offset, [](int value, const MergedConstant& c) {
+    return value < c.start;
+  });
+  if (constant != constants.begin()) constant--;
+  return constant->offset + offset - constant->start;
+}
+
+static bool hasOwnName(const ObjectFile& object, uint32_t index) {
+  string_view name = object.string(object.section(index).name);
+  for (uint32_t i = 0; i < object.sectionCount(); i++) {
+    if (i != index && object.string(object.section(i).name) == name) return false;
+  }
+  return true;
+}
+
+/* A piece of a section given to -merge is cut at the labels of its object, a constant runs from one label to the
+ * next, and only the constants no piece before it had go into the merged section. The file's symbols move to where
+ * their constants are, labels used through the section symbol are moved when the relocations are resolved.
+ * Pieces with relocations of their own are appended whole. */
+bool Linker::appendConstants(const InputObject& input, uint32_t index) {
+  const ObjectFile& object = *input.object;
+  ObjectSection section = object.section(index);
+  string_view secName = object.string(section.name);
+  if (find(mergeOptions.begin(), mergeOptions.end(), secName) == mergeOptions.end() || section.size == 0 ||
+    section.relocationCount != 0 || !hasOwnName(object, index)) return false;
+
+  vector<int> cuts = {0};
+  for (uint32_t i: input.symbols) {
+    ObjectSymbol symbol = object.symbol(i);
+    if (symbol.size != -1 || symbol.value <= 0 || symbol.value >= (int)section.size) continue;
+    auto owner = input.symbolNumbers.find(symbol.sectionNumber);
+    if (owner != input.symbolNumbers.end() && object.string(object.symbol(owner->second).name) == secName) cuts.push_back(symbol.value);
+  }
+  sort(cuts.begin(), cuts.end());
+  cuts.erase(unique(cuts.begin(), cuts.end()), cuts.end());
+
+  int ind = addSection(secName);
+  unordered_map<string_view, int>& pool = constantPools[secName];
+  vector<MergedConstant>& constants = mergedConstants[{&object, secName}];
+  const char* bytes = (const char*)object.bytes(section);
+  for (size_t i = 0; i < cuts.size(); i++) {
+    int end = i + 1 < cuts.size() ? cuts[i + 1] : section.size;
+    auto constant = pool.emplace(string_view(bytes + cuts[i], end - cuts[i]), sections[ind].size);
+    if (constant.second) {
+      ObjectSection part = section;
+      part.offset += cuts[i];
+      part.size = end - cuts[i];
+      sections[ind].pieces.push_back(SectionPiece{&object, part, index, sections[ind].size});
+      sections[ind].size += part.size;
+    }
+    constants.push_back(MergedConstant{cuts[i], end - cuts[i], constant.first->second});
+  }
+
+  Symbol* thisSection = symbolTable.getSymbolByKey(secName);
+  auto symbols = fileSymbols.find(input.name);
+  if (thisSection != nullptr && symbols != fileSymbols.end()) {
+    auto inSection = symbols->second.find(thisSection->sectionNumber);
+    if (inSection != symbols->second.end()) {
+      for (Symbol* sym: inSection->second) {
+        if (sym->name != secName) sym->value = constantOffset(constants, sym->value);
+      }
+    }
+  }
+  return true;
+}
+
+void Linker::readSections(size_t index) {
+  const InputObject& input = objects[index];
+  for (uint32_t i = 0; i < input.object->sectionCount(); i++) {
+    if ((gcSections && !livePieces[index][i]) || foldedPieces.count({index, i})) continue;
+    if (!appendConstants(input, i)) appendSection(*input.object, i, input.name);
   }
 }
 
-void Linker::parseRelocationEntry(string line, int sectionIndex, int codeSize) {
-  stringstream sstr(line);
-  string data;
-  RelocationEntry entry;
+/* A section of an object is live when it is a root or a live section has a relocation that uses it. A global
+ * leads to the section of the object that defines it, a section symbol, which is how labels local to the file
+ * are used, to the object's own section of that name, or to every one of that name if the object has none.
+ * The roots are the first section of the first input, which is where the vector table and so the reset entry
+ * go, and the sections given to -place and to -keep. Symbols defined in the sections left out go with them. */
+void Linker::collectGarbage() {
+  unordered_map<string_view, vector<pair<uint32_t, uint32_t>>> piecesByName;
+  unordered_map<string_view, vector<uint32_t>> objectsByName; // a file named twice is two objects
+  livePieces.clear();
+  for (uint32_t i = 0; i < objects.size(); i++) {
+    const ObjectFile& object = *objects[i].object;
+    livePieces.emplace_back(object.sectionCount(), false);
+    objectsByName[objects[i].name].push_back(i);
+    for (uint32_t j = 0; j < object.sectionCount(); j++) piecesByName[object.string(object.section(j).name)].push_back({i, j});
+  }
+
+  vector<pair<uint32_t, uint32_t>> work;
+  auto markAll = [&](string_view name) {
+    auto pieces = piecesByName.find(name);
+    if (pieces == piecesByName.end()) return;
+    for (auto& piece: pieces->second) {
+      if (!livePieces[piece.first][piece.second]) {
+        livePieces[piece.first][piece.second] = true;
+        work.push_back(piece);
+      }
+    }
+  };
+  auto markIn = [&](uint32_t index, string_view name) {
+    const ObjectFile& object = *objects[index].object;
+    bool found = false;
+    for (uint32_t j = 0; j < object.sectionCount(); j++) {
+      if (object.string(object.section(j).name) != name) continue;
+      found = true;
+      if (!livePieces[index][j]) {
+        livePieces[index][j] = true;
+        work.push_back({index, j});
+      }
+    }
+    if (!found) markAll(name);
+  };
+
+  if (!objects.empty() && objects[0].object->sectionCount() != 0)
+    markAll(objects[0].object->string(objects[0].object->section(0).name));
+  for (auto& place: placeOptionMap) markAll(place.first);
+  for (const string& name: keepOptions) markAll(name);
+
+  while (!work.empty()) {
+    auto piece = work.back();
+    work.pop_back();
+    const ObjectFile& object = *objects[piece.first].object;
+    ObjectSection section = object.section(piece.second);
+    for (uint32_t i = 0; i < section.relocationCount; i++) {
+      string_view name = object.string(object.symbol(object.relocation(section.firstRelocation + i).symbol).name);
+      Symbol* symbol = symbolTable.getSymbolByKey(name);
+      if (symbol == nullptr) continue; // resolution skips it as well
+      if (symbol->isSection()) {
+        markIn(piece.first, name);
+        continue;
+      }
+      auto sectionName = helperSectionMap.find(string(name));
+      auto origin = objectsByName.find(symbol->originFile);
+      if (sectionName == helperSectionMap.end() || origin == objectsByName.end()) continue;
+      for (uint32_t index: origin->second) markIn(index, sectionName->second);
+    }
+  }
 
-  getline(sstr, data, ':'); entry.realocationType = (TypeOfUse)stoi(data);
-  getline(sstr, data, ':'); entry.location = stoi(data);
-  getline(sstr, data, ':'); entry.symbolTableReference = data;
+  for (Symbol& symbol: symbolTable) {
+    if (symbol.isSection()) continue;
+    auto sectionName = helperSectionMap.find(string(symbol.name));
+    auto origin = objectsByName.find(symbol.originFile);
+    bool live = false;
+    if (sectionName != helperSectionMap.end() && origin != objectsByName.end()) {
+      for (uint32_t index: origin->second) {
+        const ObjectFile& object = *objects[index].object;
+        for (uint32_t j = 0; j < object.sectionCount(); j++) {
+          live = live || (livePieces[index][j] && object.string(object.section(j).name) == sectionName->second);
+        }
+      }
+    }
+    if (!live) droppedSymbols.insert(symbol.name);
+  }
+}
 
-  sections[sectionIndex].relocationEntries.push_back(entry);
-  if (sections[sectionIndex].sectionOccurence > 1) 
-    sections[sectionIndex].relocationEntryOffsets.push_back(codeSize);
+// hash of the bytes and of the relocations by offset, type and symbol name, false if a relocation uses a section
+// symbol, whose labels are local to the file and relative to where the section starts
+bool Linker::pieceHash(const ObjectFile& object, const ObjectSection& section, uint64_t& hash) {
+  hash = hashBytes(object.bytes(section), section.size, hashNumber(section.size));
+  for (uint32_t i = 0; i < section.relocationCount; i++) {
+    ObjectRelocation relocation = object.relocation(section.firstRelocation + i);
+    string_view name = object.string(object.symbol(relocation.symbol).name);
+    Symbol* symbol = symbolTable.getSymbolByKey(name);
+    if (symbol != nullptr && symbol->isSection()) return false;
+    hash = hashText(name, hashNumber(relocation.type, hashNumber(relocation.offset, hash)));
+  }
+  return true;
+}
+
+bool Linker::identicalPieces(const ObjectFile& a, const ObjectSection& first, const ObjectFile& b, const ObjectSection& second) {
+  if (first.size != second.size || first.relocationCount != second.relocationCount ||
+    memcmp(a.bytes(first), b.bytes(second), first.size) != 0) return false;
+  for (uint32_t i = 0; i < first.relocationCount; i++) {
+    ObjectRelocation x = a.relocation(first.firstRelocation + i), y = b.relocation(second.firstRelocation + i);
+    if (x.offset != y.offset || x.type != y.type || a.string(a.symbol(x.symbol).name) != b.string(b.symbol(y.symbol).name)) return false;
+  }
+  return true;
+}
+
+/* A piece whose bytes and relocations are those of a piece before it in link order is left out and the symbols
+ * defined in it move to that piece. The first piece of a section is never left out, as labels used through the
+ * section symbol are relative to it, and neither are pieces of placed or mergeable sections, pieces that share
+ * their name with another section of the object and pieces of an object that shares its name with another. */
+void Linker::foldIdenticalSections() {
+  unordered_map<string_view, int> objectNames;
+  for (const InputObject& input: objects) objectNames[input.name]++;
+  unordered_set<string_view> started; // sections that have their first piece
+  unordered_map<uint64_t, vector<pair<uint32_t, uint32_t>>> kept;
+  for (uint32_t i = 0; i < objects.size(); i++) {
+    const ObjectFile& object = *objects[i].object;
+    for (uint32_t j = 0; j < object.sectionCount(); j++) {
+      if (gcSections && !livePieces[i][j]) continue;
+      ObjectSection section = object.section(j);
+      string_view name = object.string(section.name);
+      bool first = section.size != 0 && started.insert(name).second;
+      uint64_t hash;
+      if (section.size == 0 || placeOptionMap.count(string(name)) || !hasOwnName(object, j) ||
+        find(mergeOptions.begin(), mergeOptions.end(), name) != mergeOptions.end() || !pieceHash(object, section, hash)) continue;
+      vector<pair<uint32_t, uint32_t>>& candidates = kept[hash];
+      auto same = find_if(candidates.begin(), candidates.end(), [&](const pair<uint32_t, uint32_t>& piece) {
+        const ObjectFile& other = *objects[piece.first].object;
+        return identicalPieces(other, other.section(piece.second), object, section);
+      });
+      if (same == candidates.end()) candidates.push_back({i, j});
+      else if (!first && objectNames[objects[i].name] == 1) foldedPieces.emplace(make_pair(i, j), *same);
+    }
+  }
+}
+
+// a folded piece's symbols are relative to the object's section, they move to the kept piece
+void Linker::redirectFoldedSymbols() {
+  map<pair<const ObjectFile*, uint32_t>, int> offsets;
+  for (const Section& section: sections) {
+    for (const SectionPiece& piece: section.pieces) offsets.emplace(make_pair(piece.object, piece.index), piece.offset);
+  }
+  for (auto& fold: foldedPieces) {
+    const InputObject& input = objects[fold.first.first];
+    const ObjectFile& keeper = *objects[fold.second.first].object;
+    string_view secName = input.object->string(input.object->section(fold.first.second).name);
+    string keptName(keeper.string(keeper.section(fold.second.second).name));
+    int offset = offsets.at({&keeper, fold.second.second});
+    Symbol* thisSection = symbolTable.getSymbolByKey(secName);
+    auto symbols = fileSymbols.find(input.name);
+    if (thisSection == nullptr || symbols == fileSymbols.end()) continue;
+    auto inSection = symbols->second.find(thisSection->sectionNumber);
+    if (inSection == symbols->second.end()) continue;
+    for (Symbol* sym: inSection->second) {
+      if (sym->name == secName) continue;
+      sym->value += offset;
+      helperSectionMap[string(sym->name)] = keptName;
+    }
+  }
 }
 
 inline bool inRange(int num, int low, int high) {
@@ -224,8 +555,8 @@ void Linker::checkForOverlappingSections() {
     if (s1.placed) {
       for(Section& s2: sections) {
         if (s2.placed && s1.name != s2.name) {
-          if (inRange(s2.startAddress + s2.code.size(), s1.startAddress, s1.startAddress + s1.code.size()) ||
-          inRange(s2.startAddress, s1.startAddress, s1.startAddress + s1.code.size()))
+          if (inRange(s2.startAddress + s2.size, s1.startAddress, s1.startAddress + s1.size) ||
+          inRange(s2.startAddress, s1.startAddress, s1.startAddress + s1.size))
             throw OverlappingSectionsError(s1.name.c_str(), s2.name.c_str());
         }
       }
@@ -233,159 +564,537 @@ void Linker::checkForOverlappingSections() {
   }
 }
 
+// copies the pieces of a section from their objects to the section's addresses and marks them used
+void Linker::packSection(const Section& section) {
+  for (const SectionPiece& piece: section.pieces) {
+    if (piece.section.size != 0)
+      memcpy(&generatedCode[section.startAddress + piece.offset], piece.object->bytes(piece.section), piece.section.size);
+  }
+  for (int address = section.startAddress; address < section.startAddress + section.size; address++) {
+    if ((address & 63) == 0 && address + 64 <= section.startAddress + section.size) { // whole words at once
+      usedAddresses[address >> 6] = ~0ull;
+      address += 63;
+    }
+    else usedAddresses[address >> 6] |= 1ull << (address & 63);
+  }
+}
+
+// first used address from address on, -1 if there is none
+int Linker::nextUsedAddress(int address) const {
+  int word = address >> 6;
+  if (word >= (int)usedAddresses.size()) return -1;
+  uint64_t bits = usedAddresses[word] & (~0ull << (address & 63));
+  while (bits == 0) {
+    if (++word == (int)usedAddresses.size()) return -1;
+    bits = usedAddresses[word];
+  }
+  return word * 64 + __builtin_ctzll(bits);
+}
+
+// first unused address from address on
+int Linker::usedRunEnd(int address) const {
+  int word = address >> 6;
+  if (word >= (int)usedAddresses.size()) return address;
+  uint64_t bits = ~usedAddresses[word] & (~0ull << (address & 63));
+  while (bits == 0) {
+    if (++word == (int)usedAddresses.size()) return word * 64;
+    bits = ~usedAddresses[word];
+  }
+  return word * 64 + __builtin_ctzll(bits);
+}
+
+// addresses are given out first, the image then only has to be as large as the highest section end
 void Linker::packCode() {
   int currentAddress = 0;
   for(Section& section: sections) { // putting sections determined with place option first
     if (section.placed) {
       if (currentAddress < section.startAddress || currentAddress == 0) 
-        currentAddress = section.startAddress + section.code.size();
-      for (int i = 0; i < section.code.size(); i++) {
-        generatedCode[section.startAddress + i] = section.code[i];
-      }
+        currentAddress = section.startAddress + section.size;
     }
   }
+  int imageSize = 65536;
   for(Section& section: sections) { // other sections afterwards
     if (!section.placed) {
       section.startAddress = currentAddress;
-      currentAddress += section.code.size();
-      for (int i = 0; i < section.code.size(); i++) {
-        generatedCode[section.startAddress + i] = section.code[i];
-      }
+      currentAddress += section.size;
     }
+    imageSize = max(imageSize, section.startAddress + section.size);
+  }
+  imageSize = (imageSize + 63) & ~63;
+  generatedCode.assign(imageSize, 0);
+  usedAddresses.assign(imageSize / 64, 0);
+  for(Section& section: sections) {
+    if (section.placed) packSection(section);
+  }
+  for(Section& section: sections) {
+    if (!section.placed) packSection(section);
   }
 }
 
-void Linker::updateSymbolAndRelocationEntryValues() {
-  for (auto& x: symbolTable.table) {
-    Symbol* symbol = x.second;
-    if (!symbol->isSection()) {
-      Symbol* section = symbolTable.getSymbolByKey(helperSectionMap.at(symbol->name));
+void Linker::updateSymbolValues() {
+  for (Symbol& symbol: symbolTable) {
+    if (!symbol.isSection() && !droppedSymbols.count(symbol.name)) {
+      Symbol* section = symbolTable.getSymbolByKey(helperSectionMap.at(string(symbol.name)));
       int sectionIndex = getSectionIndex(section->name);
-      symbol->value += sections[sectionIndex].startAddress;
+      symbol.value += sections[sectionIndex].startAddress;
     }
   }
-  for(Section& s: sections) {
-    if (s.sectionOccurence > 1) {
-      for (int i = 1; i < s.relocationEntries.size(); i++){
-        s.relocationEntries[i].location += s.relocationEntryOffsets[i - 1];
+}
+
+// relocations are read from the objects, their offsets are relative to the piece they came with
+void Linker::resolvePieceRelocations(const Section& section, const SectionPiece& piece) {
+  int addition, offset;
+  Symbol* symbol;
+  const ObjectFile& object = *piece.object;
+  for (uint32_t i = 0; i < piece.section.relocationCount; i++) {
+    ObjectRelocation entry = object.relocation(piece.section.firstRelocation + i);
+    symbol = symbolTable.getSymbolByKey(object.string(object.symbol(entry.symbol).name));
+    int location = piece.offset + entry.offset;
+    offset = section.startAddress + location;
+    if (symbol != nullptr) {
+      if (symbol->isSection()) {
+        addition = sections[getSectionIndex(symbol->name)].startAddress;
+        auto constants = mergedConstants.find({&object, symbol->name});
+        if (constants != mergedConstants.end()) { // the word is an offset in the object's piece of a mergeable section
+          int word = generatedCode[offset] | (generatedCode[offset + 1] << 8);
+          addition += constantOffset(constants->second, word) - word;
+        }
       }
+      else addition = symbol->value;
+    } else continue;
+    if ((TypeOfUse)entry.type == TypeOfUse::PC_REL) {
+      addition -= (location + section.startAddress);
     }
+    if (addition != 0) patchWord(offset, addition); // the object checked that the word is inside the piece
   }
 }
 
+void Linker::patchWord(int address, int addition) {
+  int valueFromCode = generatedCode[address] | (generatedCode[address + 1] << 8);
+  valueFromCode += addition;
+  generatedCode[address] = valueFromCode & 0xFF;
+  generatedCode[address + 1] = ((valueFromCode & 0xFF00)>>8);
+}
+
+static const size_t PIECES_PER_TASK = 64;
+
+// a relocation only patches its own piece, so pieces are independent unless sections were placed over each other,
+// in which case the pieces are patched one after another in section order
 void Linker::resolveRelocationEntries() {
-  int addition, offset, valueFromCode;
-  Symbol* symbol;
-  for(Section& section: sections) {
-    for(RelocationEntry& entry: section.relocationEntries) {
-      symbol = symbolTable.getSymbolByKey(entry.symbolTableReference);
-      if (symbol != nullptr) {
-        if (symbol->isSection()) addition = sections[getSectionIndex(symbol->name)].startAddress;
-        else addition = symbol->value;
-      } else continue;
-      if (entry.realocationType == TypeOfUse::PC_REL) {
-        addition -= (entry.location + section.startAddress);
-      }
-      offset = section.startAddress + entry.location;
-      if (addition != 0) {
-        valueFromCode = generatedCode[offset] | (generatedCode[offset + 1] << 8);
-        valueFromCode += addition;
-        generatedCode[offset] = valueFromCode & 0xFF;
-        generatedCode[offset + 1] = ((valueFromCode & 0xFF00)>>8);
-      }
+  vector<pair<const Section*, const SectionPiece*>> pieces;
+  for (const Section& section: sections) {
+    for (const SectionPiece& piece: section.pieces) {
+      if (piece.section.relocationCount != 0) pieces.push_back({&section, &piece});
     }
   }
+
+  vector<const Section*> byAddress;
+  for (const Section& section: sections) byAddress.push_back(&section);
+  sort(byAddress.begin(), byAddress.end(), [](const Section* a, const Section* b) { return a->startAddress < b->startAddress; });
+  bool disjoint = true;
+  for (size_t i = 1; i < byAddress.size(); i++) {
+    if (byAddress[i - 1]->startAddress + byAddress[i - 1]->size > byAddress[i]->startAddress) disjoint = false;
+  }
+
+  size_t tasks = (pieces.size() + PIECES_PER_TASK - 1) / PIECES_PER_TASK;
+  atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t task = next++; task < tasks; task = next++) {
+      size_t end = min(pieces.size(), (task + 1) * PIECES_PER_TASK);
+      for (size_t i = task * PIECES_PER_TASK; i < end; i++) resolvePieceRelocations(*pieces[i].first, *pieces[i].second);
+    }
+  };
+  vector<thread> pool;
+  for (size_t i = 1; disjoint && i < (size_t)jobs && i < tasks; i++) pool.emplace_back(worker);
+  worker();
+  for (thread& t: pool) t.join();
 }
 
-ofstream& Linker::formHexOutput(ofstream &output) {
-  unsigned char byte;
+// whole aligned lines of a run are encoded in one go, partial lines keep the gap and fill rules
+string Linker::formHexText() {
+  string text;
   int prevAddr = -1;
   int gap, spacesLeft;
   bool addrSet = false;
-  output << std::hex << uppercase << setfill('0');
-  for (auto& x: generatedCode) {
-    int addr = x.first;
+  for (int addr = nextUsedAddress(0); addr != -1; addr = nextUsedAddress(addr + 1)) {
     if (addr != prevAddr + 1 && prevAddr != -1) { // testing in relation to previous address
       gap = addr - prevAddr;
       spacesLeft = 7 - prevAddr % 8;
       if (spacesLeft < gap) { // if the code cannot fit in one line, break
         if (spacesLeft != 0) {
-          output << '\n';
+          text += '\n';
           addrSet = false;
         }
       } else { // else fill the gap with 0x00
-        for (int i = 0; i < gap; i++) {
-          output << setw(2) << 0x00 << ' ';
+        for (int i = 0; i < gap; i++) text += "00 ";
+      }
+    }
+    if (!addrSet && addr % 8 == 0) { // the full lines of the run starting here
+      int lines = (usedRunEnd(addr) - addr) / 8;
+      if (lines > 0) {
+        string encoded(lines * 24, ' ');
+        encodeHex(&generatedCode[addr], lines * 8, ' ', &encoded[0]);
+        for (int i = 0; i < lines; i++) {
+          appendHex(text, addr + i * 8, 4);
+          text += ": ";
+          text.append(encoded, i * 24, 23);
+          text += '\n';
         }
+        prevAddr = addr + lines * 8 - 1;
+        addr = prevAddr;
+        continue;
       }
     }
     int fillCnt;
     if ((fillCnt = addr % 8) != 0 && !addrSet) { // see if the address doesn't align with 8
-      output << setw(4) << addr - fillCnt << ": ";
-      for (int i = 0; i < fillCnt; i++) { // fill the gap before the actual data with 0x00
-        output << setw(2) << 0x00 << ' ';
-      }
+      appendHex(text, addr - fillCnt, 4);
+      text += ": ";
+      for (int i = 0; i < fillCnt; i++) text += "00 "; // fill the gap before the actual data with 0x00
       addrSet = true;
     }
     else if (fillCnt == 0 && !addrSet) { // else set the address
-      output << setw(4) << addr << ": ";
+      appendHex(text, addr, 4);
+      text += ": ";
       addrSet = true;
     }
-    byte = x.second;
-    output << setw(2) << (int)byte;
+    appendHex(text, generatedCode[addr], 2);
     if ((addr + 1) % 8 == 0) {
-      output << '\n';
+      text += '\n';
       addrSet = false;
     }
-    else output << ' ';
+    else text += ' ';
     prevAddr = addr;
   }
+  return text;
+}
+
+ofstream& Linker::formHexOutput(ofstream &output) {
+  output << formHexText();
   return output;
 }
 
-void Linker::formHexCout() {
-  unsigned char byte;
-  int prevAddr = -1;
-  int gap, spacesLeft;
-  bool addrSet = false;
-  cout << std::hex << uppercase << setfill('0');
-  for (auto& x: generatedCode) {
-    int addr = x.first;
-    if (addr != prevAddr + 1 && prevAddr != -1) { // testing in relation to previous address
-      gap = addr - prevAddr;
-      spacesLeft = 7 - prevAddr % 8;
-      if (spacesLeft < gap) { // if the code cannot fit in one line, break
-        if (spacesLeft != 0) {
-          cout << '\n';
-          addrSet = false;
-        }
-      } else { // else fill the gap with 0x00
-        for (int i = 0; i < gap; i++) {
-          cout << setw(2) << 0x00 << ' ';
-        }
+// runs of consecutive addresses become segments, global symbols go to the symbol table
+string Linker::formBinaryOutput() {
+  vector<ImageSegment> segments;
+  for (int start = nextUsedAddress(0); start != -1; ) {
+    int end = usedRunEnd(start);
+    segments.push_back(ImageSegment{(uint32_t)start, (uint32_t)(end - start), 0});
+    start = nextUsedAddress(end);
+  }
+  string strings;
+  vector<ImageSymbol> symbols;
+  for (Symbol* symbol: symbolTable.sortedByName()) {
+    if (symbol->isSection() || droppedSymbols.count(symbol->name)) continue;
+    symbols.push_back(ImageSymbol{(uint32_t)symbol->value, (uint32_t)strings.size()});
+    strings += symbol->name;
+    strings += '\0';
+  }
+
+  uint32_t segmentTable = IMAGE_HEADER_SIZE;
+  uint32_t symbolTable = segmentTable + segments.size() * IMAGE_SEGMENT_SIZE;
+  uint32_t lineTable = symbolTable + symbols.size() * IMAGE_SYMBOL_SIZE;
+  uint32_t stringTable = lineTable; // no line information comes with the object files
+  uint32_t data = stringTable + strings.size();
+  for (ImageSegment& segment: segments) {
+    segment.offset = data;
+    data += segment.size;
+  }
+
+  vector<unsigned char> image(data, 0);
+  unsigned char* p = image.data();
+  memcpy(p, IMAGE_MAGIC, 4);
+  writeImage16(p + 4, IMAGE_VERSION);
+  writeImage16(p + 6, isUsed(0) ? generatedCode[0] | (isUsed(1) ? generatedCode[1] << 8 : 0) : 0);
+  writeImage16(p + 8, segments.size());
+  writeImage16(p + 10, symbols.size());
+  writeImage16(p + 12, 0);
+  writeImage16(p + 14, 0);
+  writeImage32(p + 16, segmentTable);
+  writeImage32(p + 20, symbolTable);
+  writeImage32(p + 24, lineTable);
+  writeImage32(p + 28, stringTable);
+  for (size_t i = 0; i < segments.size(); i++) {
+    unsigned char* entry = p + segmentTable + i * IMAGE_SEGMENT_SIZE;
+    writeImage32(entry, segments[i].address);
+    writeImage32(entry + 4, segments[i].size);
+    writeImage32(entry + 8, segments[i].offset);
+    memcpy(p + segments[i].offset, &generatedCode[segments[i].address], segments[i].size);
+  }
+  for (size_t i = 0; i < symbols.size(); i++) {
+    writeImage32(p + symbolTable + i * IMAGE_SYMBOL_SIZE, symbols[i].value);
+    writeImage32(p + symbolTable + i * IMAGE_SYMBOL_SIZE + 4, symbols[i].name);
+  }
+  memcpy(p + stringTable, strings.data(), strings.size());
+  return string((const char*)p, image.size());
+}
+
+// one object out of all inputs: a section symbol per merged section, the defined globals relative to their merged
+// section, the externs nobody defined, and every relocation moved by the offset of the piece it came with
+void Linker::formRelocatableOutput(ofstream& output) {
+  vector<pair<string_view, ObjectSymbol>> symbols;
+  symbols.push_back({"UND", ObjectSymbol{0, 0, 0, 0, 0, 0}});
+  for (size_t i = 0; i < sections.size(); i++) {
+    int32_t number = i + 1;
+    symbols.push_back({sections[i].name, ObjectSymbol{0, number, number, 0, sections[i].size, OBJECT_SYMBOL_GLOBAL | OBJECT_SYMBOL_EXTERN}});
+  }
+  int32_t number = sections.size() + 1;
+  for (Symbol* symbol: symbolTable.sortedByName()) {
+    if (symbol->isSection() || symbol->name == "UND") continue;
+    auto section = helperSectionMap.find(string(symbol->name));
+    if (symbol->isOnlyExtern() || section == helperSectionMap.end())
+      symbols.push_back({symbol->name, ObjectSymbol{0, number++, 0, 0, -1, OBJECT_SYMBOL_EXTERN}});
+    else
+      symbols.push_back({symbol->name, ObjectSymbol{0, number++, getSectionIndex(section->second) + 1, symbol->value, -1, OBJECT_SYMBOL_GLOBAL}});
+  }
+  sort(symbols.begin(), symbols.end(), [](const pair<string_view, ObjectSymbol>& a, const pair<string_view, ObjectSymbol>& b) {
+    return a.first < b.first;
+  });
+
+  string strings;
+  vector<ObjectSymbol> objectSymbols;
+  unordered_map<string_view, uint32_t> symbolIndex;
+  for (auto& symbol: symbols) {
+    symbol.second.name = strings.size();
+    strings += symbol.first;
+    strings += '\0';
+    symbolIndex.emplace(symbol.first, objectSymbols.size());
+    objectSymbols.push_back(symbol.second);
+  }
+
+  vector<ObjectSection> objectSections;
+  vector<vector<unsigned char>> code(sections.size());
+  vector<const unsigned char*> bytes;
+  vector<ObjectRelocation> relocations;
+  for (size_t i = 0; i < sections.size(); i++) {
+    uint32_t name = objectSymbols[symbolIndex.at(sections[i].name)].name;
+    objectSections.push_back(ObjectSection{name, 0, (uint32_t)sections[i].size, (uint32_t)relocations.size(), 0});
+    for (const SectionPiece& piece: sections[i].pieces) {
+      const ObjectFile& object = *piece.object;
+      const unsigned char* pieceBytes = object.bytes(piece.section);
+      code[i].insert(code[i].end(), pieceBytes, pieceBytes + piece.section.size);
+      for (uint32_t j = 0; j < piece.section.relocationCount; j++) {
+        ObjectRelocation relocation = object.relocation(piece.section.firstRelocation + j);
+        auto symbol = symbolIndex.find(object.string(object.symbol(relocation.symbol).name));
+        if (symbol == symbolIndex.end()) continue; // the final link would not resolve it either
+        relocations.push_back(ObjectRelocation{piece.offset + relocation.offset, symbol->second, relocation.type});
+        objectSections.back().relocationCount++;
       }
     }
-    int fillCnt;
-    if ((fillCnt = addr % 8) != 0 && !addrSet) { // see if the address doesn't align with 8
-      cout << setw(4) << addr - fillCnt << ": ";
-      for (int i = 0; i < fillCnt; i++) { // fill the gap before the actual data with 0x00
-        cout << setw(2) << 0x00 << ' ';
-      }
-      addrSet = true;
+    bytes.push_back(code[i].data());
+  }
+
+  vector<unsigned char> object = writeObject(objectSymbols, objectSections, bytes, relocations, strings);
+  output.write((const char*)object.data(), object.size());
+}
+
+void Linker::formHexCout() {
+  cout << formHexText();
+}
+
+/* incremental linking */
+
+// what resolution and layout depend on: the names and sizes of the sections and the symbols without their values
+static uint64_t objectShape(const InputObject& input) {
+  const ObjectFile& object = *input.object;
+  uint64_t hash = hashNumber(input.symbols.size(), hashNumber(object.sectionCount()));
+  for (uint32_t i = 0; i < object.sectionCount(); i++) {
+    ObjectSection section = object.section(i);
+    hash = hashNumber(section.size, hashText(object.string(section.name), hash));
+  }
+  for (uint32_t index: input.symbols) {
+    ObjectSymbol symbol = object.symbol(index);
+    hash = hashNumber(symbol.flags, hashNumber(symbol.size, hashText(object.string(symbol.name), hash)));
+    if (symbol.size != -1 || symbol.sectionNumber == 0) continue;
+    auto section = input.symbolNumbers.find(symbol.sectionNumber);
+    if (section == input.symbolNumbers.end()) hash = hashNumber(-1, hash);
+    else hash = hashText(object.string(object.symbol(section->second).name), hash);
+  }
+  return hash;
+}
+
+// value of the symbol resolution took from the object for the name
+static bool symbolValue(const InputObject& input, string_view name, int32_t& value) {
+  const ObjectFile& object = *input.object;
+  auto found = lower_bound(input.symbols.begin(), input.symbols.end(), name, [&object](uint32_t index, string_view key) {
+    return object.string(object.symbol(index).name) < key;
+  });
+  if (found == input.symbols.end() || object.string(object.symbol(*found).name) != name) return false;
+  value = object.symbol(*found).value;
+  return true;
+}
+
+string Linker::layoutOptions() const {
+  vector<pair<string, int>> places(placeOptionMap.begin(), placeOptionMap.end());
+  sort(places.begin(), places.end());
+  string options = binary ? "bin" : "hex";
+  if (gcSections) options += " gc";
+  if (icf) options += " icf";
+  for (const string& name: mergeOptions) options += " merge=" + name;
+  for (auto& place: places) options += " " + place.first + "@" + to_string(place.second);
+  return options;
+}
+
+void Linker::collectSites(const Section& section, const SectionPiece& piece, const unordered_map<string_view, uint32_t>& symbolIndexes,
+  vector<LinkStateSite>& sites) {
+  const ObjectFile& object = *piece.object;
+  for (uint32_t i = 0; i < piece.section.relocationCount; i++) {
+    ObjectRelocation entry = object.relocation(piece.section.firstRelocation + i);
+    auto symbol = symbolIndexes.find(object.string(object.symbol(entry.symbol).name));
+    if (symbol != symbolIndexes.end())
+      sites.push_back(LinkStateSite{(uint32_t)(section.startAddress + piece.offset + entry.offset), symbol->second});
+  }
+}
+
+// the state of a full link, false if a relink could not rely on it
+bool Linker::collectLinkState() {
+  // what is linked depends on the relocations or the bytes, which a relink does not compare
+  if (gcSections || icf || !mergeOptions.empty()) return false;
+  state = LinkState();
+  state.options = layoutOptions();
+  for (const string& name: input) {
+    LinkStateInput file;
+    if (!statFile(name, file) || !hashFile(name, file.hash)) return false;
+    state.inputs.push_back(file);
+  }
+
+  unordered_map<string_view, uint32_t> objectIndexes; // symbols know their object by name, a file named twice is ambiguous
+  unordered_map<const ObjectFile*, uint32_t> pieceObjects;
+  for (size_t i = 0; i < objects.size(); i++) {
+    if (!objectIndexes.emplace(objects[i].name, i).second) return false;
+    pieceObjects.emplace(objects[i].object.get(), i);
+    LinkStateObject object;
+    object.name = objects[i].name;
+    object.input = objects[i].source;
+    object.shape = objectShape(objects[i]);
+    object.pieces.resize(objects[i].object->sectionCount());
+    state.objects.push_back(move(object));
+  }
+  unordered_map<string_view, uint32_t> symbolIndexes;
+  for (Symbol* symbol: symbolTable.sortedByName()) {
+    symbolIndexes.emplace(symbol->name, state.symbols.size());
+    state.symbols.push_back(LinkStateSymbol{string(symbol->name), symbol->value, symbol->size});
+  }
+  for (const Section& section: sections) {
+    state.sections.push_back(LinkStateSection{section.name, section.startAddress, section.size});
+    for (const SectionPiece& piece: section.pieces) {
+      LinkStateObject& object = state.objects[pieceObjects.at(piece.object)];
+      object.pieces[piece.index] = LinkStatePiece{(uint32_t)(section.startAddress + piece.offset), piece.section.size};
+      collectSites(section, piece, symbolIndexes, object.sites);
     }
-    else if (fillCnt == 0 && !addrSet) { // else set the address
-      cout << setw(4) << addr << ": ";
-      addrSet = true;
+  }
+  for (Symbol& symbol: symbolTable) {
+    if (symbol.isSection() || symbol.originFile.empty()) continue;
+    uint32_t index = objectIndexes.at(symbol.originFile);
+    int32_t value;
+    if (!symbolValue(objects[index], symbol.name, value)) return false;
+    state.objects[index].origins.push_back(LinkStateOrigin{symbolIndexes.at(symbol.name), symbol.value - value});
+  }
+  return true;
+}
+
+/* A relink keeps the layout of the last link when the files that changed are objects of the same shape. Their bytes
+ * are copied over their old pieces and their relocations are applied again, the symbols they provide get their new
+ * values and every other relocation that uses one of those symbols moves by the difference. Anything else, from a
+ * changed archive to sections placed over each other, makes it a full link, which also reports any errors. */
+bool Linker::relinkIncrementally() {
+  if (!readLinkState(stateName(), state) || state.options != layoutOptions() || state.inputs.size() != input.size()) return false;
+  vector<bool> changed(input.size(), false);
+  for (size_t i = 0; i < input.size(); i++) {
+    LinkStateInput file;
+    LinkStateInput& last = state.inputs[i];
+    if (last.name != input[i] || !statFile(input[i], file)) return false;
+    if (file.size == last.size && file.modified == last.modified) continue;
+    if (!hashFile(input[i], file.hash)) return false;
+    changed[i] = file.hash != last.hash;
+    if (changed[i] && isArchiveName(input[i])) return false;
+    last = file;
+  }
+
+  unordered_map<string_view, const LinkStateSection*> lastSections;
+  vector<const LinkStateSection*> byAddress;
+  for (const LinkStateSection& section: state.sections) {
+    if (section.startAddress < 0 || section.size < 0 || (uint64_t)section.startAddress + section.size > state.code.size()) return false;
+    lastSections.emplace(section.name, &section);
+    byAddress.push_back(&section);
+  }
+  sort(byAddress.begin(), byAddress.end(), [](const LinkStateSection* a, const LinkStateSection* b) { return a->startAddress < b->startAddress; });
+  for (size_t i = 1; i < byAddress.size(); i++) {
+    if (byAddress[i - 1]->startAddress + byAddress[i - 1]->size > byAddress[i]->startAddress) return false;
+  }
+
+  // the changed objects are read and checked before anything of the last link is taken over
+  vector<pair<uint32_t, InputObject>> relinked;
+  for (uint32_t i = 0; i < state.objects.size(); i++) {
+    const LinkStateObject& last = state.objects[i];
+    if (!changed[last.input]) continue;
+    InputObject object(last.name, last.input);
+    try {
+      object.object.reset(new ObjectFile(last.name));
+      indexSymbols(object);
+    } catch (...) {
+      return false;
     }
-    byte = x.second;
-    cout << setw(2) << (int)byte;
-    if ((addr + 1) % 8 == 0) {
-      cout << '\n';
-      addrSet = false;
+    if (objectShape(object) != last.shape || object.object->sectionCount() != last.pieces.size()) return false;
+    for (uint32_t j = 0; j < object.object->sectionCount(); j++) {
+      auto section = lastSections.find(object.object->string(object.object->section(j).name));
+      if (section == lastSections.end() || last.pieces[j].address < (uint32_t)section->second->startAddress ||
+        last.pieces[j].address + last.pieces[j].size > (uint32_t)(section->second->startAddress + section->second->size)) return false;
     }
-    else cout << ' ';
-    prevAddr = addr;
+    int32_t value;
+    for (const LinkStateOrigin& origin: last.origins) {
+      if (!symbolValue(object, state.symbols[origin.symbol].name, value)) return false;
+    }
+    relinked.emplace_back(i, move(object));
+  }
+
+  generatedCode.swap(state.code);
+  usedAddresses.swap(state.used);
+  symbolTable.emptyTable();
+  unordered_map<string_view, uint32_t> symbolIndexes;
+  for (size_t i = 0; i < state.symbols.size(); i++) {
+    symbolTable.insertSymbol(state.symbols[i].name, state.symbols[i].value, false, false, state.symbols[i].size, 0, i);
+    symbolIndexes.emplace(state.symbols[i].name, i);
+  }
+  sections.reserve(state.sections.size());
+  for (const LinkStateSection& last: state.sections) {
+    sections.push_back(Section(last.name));
+    sections.back().startAddress = last.startAddress;
+    sections.back().size = last.size;
+  }
+  for (size_t i = 0; i < sections.size(); i++) sectionIndexes.emplace(sections[i].name, i);
+
+  vector<int32_t> delta(state.symbols.size(), 0);
+  for (auto& relink: relinked) {
+    for (const LinkStateOrigin& origin: state.objects[relink.first].origins) {
+      LinkStateSymbol& symbol = state.symbols[origin.symbol];
+      int32_t value;
+      symbolValue(relink.second, symbol.name, value);
+      delta[origin.symbol] = origin.base + value - symbol.value;
+      symbol.value = origin.base + value;
+      symbolTable.getSymbolByKey(symbol.name)->value = symbol.value;
+    }
+  }
+  for (const LinkStateObject& object: state.objects) {
+    if (changed[object.input]) continue;
+    for (const LinkStateSite& site: object.sites) {
+      if (delta[site.symbol] != 0) patchWord(site.address, delta[site.symbol]);
+    }
+  }
+  for (auto& relink: relinked) {
+    LinkStateObject& last = state.objects[relink.first];
+    const ObjectFile& object = *relink.second.object;
+    last.sites.clear();
+    for (uint32_t i = 0; i < object.sectionCount(); i++) {
+      ObjectSection section = object.section(i);
+      Section& merged = sections[getSectionIndex(object.string(section.name))];
+      if (section.size != 0) memcpy(&generatedCode[last.pieces[i].address], object.bytes(section), section.size);
+      SectionPiece piece{&object, section, i, (int)last.pieces[i].address - merged.startAddress};
+      resolvePieceRelocations(merged, piece);
+      collectSites(merged, piece, symbolIndexes, last.sites);
+    }
+    objects.push_back(move(relink.second));
   }
+  return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -395,16 +1104,35 @@ int main(int argc, char* argv[]) {
     const char* hexOption = "-hex";
     bool hex = false;
 
+    const char* binOption = "-bin";
+    bool bin = false;
+
     const char* relOption = "-relocatable";
     bool rel = false;
 
+    const char* incrementalOption = "-incremental"; // relinks from the state kept next to the output
+    const char* verifyOption = "-verify-incremental"; // and checks the result against a clean link
+    bool incremental = false, verify = false;
+
+    const char* jobsOption = "-j"; // threads reading the inputs, the output does not depend on it
+    int jobs = max(1u, thread::hardware_concurrency());
+
+    const char* gcOption = "-gc-sections"; // links only the sections reachable from the vector table and the kept ones
+    bool gc = false;
+    regex keepRegex("^-keep=(\\w+)$");
+
+    const char* icfOption = "-icf"; // folds sections identical to one before them
+    bool icf = false;
+    regex mergeRegex("^-merge=(\\w+)$"); // equal constants of the section are kept once
+
     regex placeRegex("^-place=(\\w+)@(\\d+|0x[\\da-fA-F]+)$");
     string placeOption;
     smatch match;
 
     string output = "linkerOutput.hex";
+    bool outputSet = false;
     string inputFile;
-    regex inputRegex("^.*\\.o$");
+    regex inputRegex("^.*\\.(o|a)$"); // objects and archives
     vector<string> input;
 
     Linker* linker = nullptr;
@@ -412,23 +1140,62 @@ int main(int argc, char* argv[]) {
     int ind = 1;
     while (ind < argc) {
       if (strcmp(hexOption, argv[ind]) == 0) {
-        if (rel) throw InvalidCmdArgs();
+        if (rel || bin) throw InvalidCmdArgs();
         hex = true;
         ind++;
         continue;
       }
+      if (strcmp(binOption, argv[ind]) == 0) { // executable as a binary image
+        if (rel || hex) throw InvalidCmdArgs();
+        bin = true;
+        ind++;
+        continue;
+      }
       if (strcmp(relOption, argv[ind]) == 0) {
-        if (hex) throw InvalidCmdArgs();
+        if (hex || bin) throw InvalidCmdArgs();
         rel = true;
         ind++;
         continue;
       }
+      if (strcmp(incrementalOption, argv[ind]) == 0 || strcmp(verifyOption, argv[ind]) == 0) {
+        incremental = true;
+        verify = verify || strcmp(verifyOption, argv[ind]) == 0;
+        ind++;
+        continue;
+      }
+      if (strcmp(gcOption, argv[ind]) == 0) {
+        gc = true;
+        ind++;
+        continue;
+      }
+      if (strcmp(icfOption, argv[ind]) == 0) {
+        icf = true;
+        ind++;
+        continue;
+      }
+      if (strcmp(jobsOption, argv[ind]) == 0) {
+        if (ind + 1 == argc || atoi(argv[ind + 1]) < 1) throw InvalidCmdArgs();
+        jobs = atoi(argv[ind + 1]);
+        ind += 2;
+        continue;
+      }
       if (strcmp(outputOption, argv[ind]) == 0) {
+        outputSet = true;
         output = argv[ind + 1];
         ind += 2;
         continue;
       }
       placeOption = argv[ind];
+      if (regex_search(placeOption, match, keepRegex)) {
+        keepOptions.push_back(match[1]);
+        ind++;
+        continue;
+      }
+      if (regex_search(placeOption, match, mergeRegex)) {
+        mergeOptions.push_back(match[1]);
+        ind++;
+        continue;
+      }
       if (regex_search(placeOption, match, placeRegex)) {
         string addr = match[2];
         string sec = match[1];
@@ -448,7 +1215,8 @@ int main(int argc, char* argv[]) {
       if (ind != argc) throw InvalidCmdArgs();
     }
 
-    linker = new Linker(input, hex, rel, output);
+    if (rel && !outputSet) output = "linkerOutput.o";
+    linker = new Linker(input, hex || bin, rel, output, bin, jobs, incremental, verify, gc, icf);
 
     linker->link();
 
@@ -0,0 +1,248 @@
+#include "../inc/ObjectFile.hpp"
+#include "../inc/Exceptions.hpp"
+#include "../inc/HexCodec.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <charconv>
+#include <unordered_map>
+
+std::vector<unsigned char> writeObject(const std::vector<ObjectSymbol>& symbols, const std::vector<ObjectSection>& sections,
+  const std::vector<const unsigned char*>& bytes, const std::vector<ObjectRelocation>& relocations, const std::string& strings) {
+  uint32_t symbolTable = OBJECT_HEADER_SIZE;
+  uint32_t sectionTable = symbolTable + symbols.size() * OBJECT_SYMBOL_SIZE;
+  uint32_t relocationTable = sectionTable + sections.size() * OBJECT_SECTION_SIZE;
+  uint32_t stringTable = relocationTable + relocations.size() * OBJECT_RELOCATION_SIZE;
+  uint32_t data = stringTable + strings.size();
+  std::vector<uint32_t> offsets;
+  for (const ObjectSection& section: sections) {
+    offsets.push_back(data);
+    data += section.size;
+  }
+
+  std::vector<unsigned char> object(data, 0);
+  unsigned char* p = object.data();
+  memcpy(p, OBJECT_MAGIC, 4);
+  writeImage16(p + 4, OBJECT_VERSION);
+  writeImage16(p + 6, 0);
+  writeImage32(p + 8, symbols.size());
+  writeImage32(p + 12, sections.size());
+  writeImage32(p + 16, relocations.size());
+  writeImage32(p + 20, symbolTable);
+  writeImage32(p + 24, sectionTable);
+  writeImage32(p + 28, relocationTable);
+  writeImage32(p + 32, stringTable);
+  writeImage32(p + 36, strings.size());
+  for (size_t i = 0; i < symbols.size(); i++) {
+    unsigned char* entry = p + symbolTable + i * OBJECT_SYMBOL_SIZE;
+    writeImage32(entry, symbols[i].name);
+    writeImage32(entry + 4, symbols[i].number);
+    writeImage32(entry + 8, symbols[i].sectionNumber);
+    writeImage32(entry + 12, symbols[i].value);
+    writeImage32(entry + 16, symbols[i].size);
+    writeImage32(entry + 20, symbols[i].flags);
+  }
+  for (size_t i = 0; i < sections.size(); i++) {
+    unsigned char* entry = p + sectionTable + i * OBJECT_SECTION_SIZE;
+    writeImage32(entry, sections[i].name);
+    writeImage32(entry + 4, offsets[i]);
+    writeImage32(entry + 8, sections[i].size);
+    writeImage32(entry + 12, sections[i].firstRelocation);
+    writeImage32(entry + 16, sections[i].relocationCount);
+    if (sections[i].size != 0) memcpy(p + offsets[i], bytes[i], sections[i].size);
+  }
+  for (size_t i = 0; i < relocations.size(); i++) {
+    unsigned char* entry = p + relocationTable + i * OBJECT_RELOCATION_SIZE;
+    writeImage32(entry, relocations[i].offset);
+    writeImage32(entry + 4, relocations[i].symbol);
+    writeImage32(entry + 8, relocations[i].type);
+  }
+  memcpy(p + stringTable, strings.data(), strings.size());
+  return object;
+}
+
+/* text objects */
+static bool nextLine(std::string_view text, size_t& position, std::string_view& line) {
+  if (position >= text.size()) return false;
+  size_t end = text.find('\n', position);
+  if (end == std::string_view::npos) end = text.size();
+  line = text.substr(position, end - position);
+  position = end + 1;
+  return true;
+}
+
+// fields are terminated by ':'
+static bool nextField(std::string_view& rest, std::string_view& field) {
+  size_t end = rest.find(':');
+  if (end == std::string_view::npos) return false;
+  field = rest.substr(0, end);
+  rest.remove_prefix(end + 1);
+  return true;
+}
+
+static bool numberField(std::string_view& rest, int32_t& value) {
+  std::string_view field;
+  if (!nextField(rest, field)) return false;
+  auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+  return result.ec == std::errc() && result.ptr == field.data() + field.size();
+}
+
+static bool flagField(std::string_view& rest, uint32_t& flags, uint32_t flag) {
+  std::string_view field;
+  if (!nextField(rest, field)) return false;
+  if (field == "true") flags |= flag;
+  return true;
+}
+
+// the symbol table, then per section its name, its bytes in hex and its relocations, which name their symbol
+void ObjectFile::translateText(std::string_view text) {
+  std::vector<ObjectSymbol> symbols;
+  std::vector<ObjectSection> sections;
+  std::vector<ObjectRelocation> relocations;
+  std::vector<std::vector<unsigned char>> code;
+  std::string strings;
+  std::unordered_map<std::string_view, uint32_t> symbolIndex;
+
+  size_t position = 0;
+  std::string_view line, rest, name;
+  while (nextLine(text, position, line) && line != "end symbol table") {
+    ObjectSymbol symbol = {(uint32_t)strings.size(), 0, 0, 0, 0, 0};
+    rest = line;
+    if (!nextField(rest, name) || !numberField(rest, symbol.sectionNumber) || !numberField(rest, symbol.value) ||
+      !flagField(rest, symbol.flags, OBJECT_SYMBOL_GLOBAL) || !flagField(rest, symbol.flags, OBJECT_SYMBOL_EXTERN) ||
+      !numberField(rest, symbol.number) || !numberField(rest, symbol.size)) throw InvalidObjectError();
+    strings += name;
+    strings += '\0';
+    symbolIndex.emplace(name, symbols.size());
+    symbols.push_back(symbol);
+  }
+
+  std::string_view hex;
+  while (nextLine(text, position, line) && line != "end file") { // "new section"
+    if (!nextLine(text, position, name) || !nextLine(text, position, hex)) throw InvalidObjectError();
+    code.emplace_back(hex.size() / 3 + 1);
+    long count = decodeHex(hex.data(), hex.size(), ':', code.back().data());
+    if (count < 0) throw InvalidHexError();
+    sections.push_back(ObjectSection{(uint32_t)strings.size(), 0, (uint32_t)count, (uint32_t)relocations.size(), 0});
+    strings += name;
+    strings += '\0';
+
+    if (!nextLine(text, position, line)) break; // "rel entries" or "end section"
+    if (line != "rel entries") continue;
+    while (nextLine(text, position, line) && line != "end rel entries") {
+      int32_t type, offset;
+      std::string_view symbol;
+      rest = line;
+      if (!numberField(rest, type) || !numberField(rest, offset) || !nextField(rest, symbol)) throw InvalidObjectError();
+      auto found = symbolIndex.find(symbol);
+      if (found == symbolIndex.end()) throw InvalidObjectError();
+      relocations.push_back(ObjectRelocation{(uint32_t)offset, found->second, (uint32_t)type});
+      sections.back().relocationCount++;
+    }
+    nextLine(text, position, line); // "end section"
+  }
+
+  std::vector<const unsigned char*> bytes;
+  for (std::vector<unsigned char>& c: code) bytes.push_back(c.data());
+  translated = writeObject(symbols, sections, bytes, relocations, strings);
+}
+
+/* ObjectFile */
+ObjectFile::ObjectFile(const std::string& name) : mapping(nullptr), size(0), data(nullptr) {
+  int descriptor = open(name.c_str(), O_RDONLY);
+  if (descriptor < 0) throw UnknownFileError(name.c_str());
+  struct stat status;
+  bool readable = fstat(descriptor, &status) == 0;
+  if (readable && status.st_size > 0) {
+    mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    readable = mapping != MAP_FAILED;
+    if (readable) size = status.st_size;
+    else mapping = nullptr;
+  }
+  close(descriptor);
+  if (!readable) throw UnknownFileError(name.c_str());
+
+  if (size >= OBJECT_HEADER_SIZE && memcmp(mapping, OBJECT_MAGIC, 4) == 0) data = (const unsigned char*)mapping;
+  else { // a text object is not needed once it is translated
+    try {
+      translateText(std::string_view((const char*)mapping, size));
+    } catch (...) {
+      if (mapping != nullptr) munmap(mapping, size);
+      throw;
+    }
+    if (mapping != nullptr) munmap(mapping, size);
+    mapping = nullptr;
+    size = translated.size();
+    data = translated.data();
+  }
+  readHeader();
+}
+
+ObjectFile::ObjectFile(const unsigned char* contents, size_t length) : mapping(nullptr), size(length), data(contents) {
+  if (size < OBJECT_HEADER_SIZE || memcmp(data, OBJECT_MAGIC, 4) != 0) throw InvalidObjectError();
+  readHeader();
+}
+
+void ObjectFile::readHeader() {
+  memcpy(header.magic, data, 4);
+  header.version = readImage16(data + 4);
+  header.flags = readImage16(data + 6);
+  header.symbolCount = readImage32(data + 8);
+  header.sectionCount = readImage32(data + 12);
+  header.relocationCount = readImage32(data + 16);
+  header.symbolTable = readImage32(data + 20);
+  header.sectionTable = readImage32(data + 24);
+  header.relocationTable = readImage32(data + 28);
+  header.stringTable = readImage32(data + 32);
+  header.stringSize = readImage32(data + 36);
+
+  // every table and every reference into one is checked here, the accessors trust them afterwards
+  bool valid = header.version == OBJECT_VERSION &&
+    (uint64_t)header.symbolTable + (uint64_t)header.symbolCount * OBJECT_SYMBOL_SIZE <= size &&
+    (uint64_t)header.sectionTable + (uint64_t)header.sectionCount * OBJECT_SECTION_SIZE <= size &&
+    (uint64_t)header.relocationTable + (uint64_t)header.relocationCount * OBJECT_RELOCATION_SIZE <= size &&
+    (uint64_t)header.stringTable + header.stringSize <= size &&
+    (header.stringSize == 0 || data[header.stringTable + header.stringSize - 1] == '\0');
+  for (uint32_t i = 0; valid && i < header.symbolCount; i++) {
+    valid = symbol(i).name < header.stringSize;
+  }
+  for (uint32_t i = 0; valid && i < header.sectionCount; i++) {
+    ObjectSection s = section(i);
+    valid = s.name < header.stringSize && (uint64_t)s.offset + s.size <= size &&
+      (uint64_t)s.firstRelocation + s.relocationCount <= header.relocationCount;
+    for (uint32_t j = 0; valid && j < s.relocationCount; j++) { // every relocation patches a word of its section
+      valid = (uint64_t)relocation(s.firstRelocation + j).offset + 2 <= s.size;
+    }
+  }
+  for (uint32_t i = 0; valid && i < header.relocationCount; i++) {
+    valid = relocation(i).symbol < header.symbolCount;
+  }
+  if (!valid) {
+    if (mapping != nullptr) munmap(mapping, size);
+    mapping = nullptr;
+    throw InvalidObjectError();
+  }
+}
+
+ObjectFile::~ObjectFile() {
+  if (mapping != nullptr) munmap(mapping, size);
+}
+
+ObjectSymbol ObjectFile::symbol(uint32_t index) const {
+  const unsigned char* entry = data + header.symbolTable + index * OBJECT_SYMBOL_SIZE;
+  return ObjectSymbol{readImage32(entry), (int32_t)readImage32(entry + 4), (int32_t)readImage32(entry + 8),
+    (int32_t)readImage32(entry + 12), (int32_t)readImage32(entry + 16), readImage32(entry + 20)};
+}
+
+ObjectSection ObjectFile::section(uint32_t index) const {
+  const unsigned char* entry = data + header.sectionTable + index * OBJECT_SECTION_SIZE;
+  return ObjectSection{readImage32(entry), readImage32(entry + 4), readImage32(entry + 8),
+    readImage32(entry + 12), readImage32(entry + 16)};
+}
+
+ObjectRelocation ObjectFile::relocation(uint32_t index) const {
+  const unsigned char* entry = data + header.relocationTable + index * OBJECT_RELOCATION_SIZE;
+  return ObjectRelocation{readImage32(entry), readImage32(entry + 4), readImage32(entry + 8)};
+}
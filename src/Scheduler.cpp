@@ -0,0 +1,35 @@
+#include "../inc/Scheduler.hpp"
+#include <algorithm>
+
+static bool later(const ScheduledEvent& a, const ScheduledEvent& b) {return a.due > b.due;}
+
+void EventScheduler::schedule(int device, unsigned long long due) {
+  cancel(device);
+  heap.push_back(ScheduledEvent(due, device, generations[device]));
+  std::push_heap(heap.begin(), heap.end(), later);
+}
+
+void EventScheduler::cancel(int device) {
+  generations[device]++;
+}
+
+void EventScheduler::dropCancelled() {
+  while (!heap.empty() && heap.front().generation != generations[heap.front().device]) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    heap.pop_back();
+  }
+}
+
+unsigned long long EventScheduler::nextDue() {
+  dropCancelled();
+  return heap.empty() ? NEVER : heap.front().due;
+}
+
+int EventScheduler::popDue(unsigned long long now) {
+  dropCancelled();
+  if (heap.empty() || heap.front().due > now) return -1;
+  int device = heap.front().device;
+  std::pop_heap(heap.begin(), heap.end(), later);
+  heap.pop_back();
+  return device;
+}
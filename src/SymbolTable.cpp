@@ -1,59 +1,143 @@
 #include "../inc/SymbolTable.hpp"
+#include <algorithm>
+#include <cstring>
 
-int Symbol::nextNumber = 0;
-int Symbol::currentSectionNumber = 0;
-std::string SymbolTable::currentSection = "UND";
+static const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+/* NameArena */
+std::string_view NameArena::intern(std::string_view text) {
+  size_t needed = text.size() + 1;
+  if (used + needed > capacity) {
+    capacity = std::max(ARENA_BLOCK_SIZE, needed);
+    blocks.emplace_back(new char[capacity]);
+    used = 0;
+  }
+  char* copy = blocks.back().get() + used;
+  memcpy(copy, text.data(), text.size());
+  copy[text.size()] = '\0';
+  used += needed;
+  return std::string_view(copy, text.size());
+}
+
+void NameArena::clear() {
+  blocks.clear();
+  used = capacity = 0;
+}
+
+/* SymbolTable */
+static size_t hashName(std::string_view name) { // FNV-1a
+  size_t hash = 14695981039346656037ull;
+  for (char c: name) hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+  return hash;
+}
 
 SymbolTable::SymbolTable(){
-  table.emplace("UND", new Symbol("UND", 0, false, false, 0, false));
+  nameIndex.assign(64, -1);
+  nextNumber = 0;
+  currentSectionNumber = 0;
+  currentSection = "UND";
+  addSymbol("UND", 0, false, false, 0, false);
 }
 
-Symbol* SymbolTable::getSymbolByKey(std::string key) {
-  std::map<std::string, Symbol*>::iterator it = table.find(key);
-  if (it != table.end()) {
-    return it->second;
-  } else return nullptr;
+void SymbolTable::growNameIndex() {
+  nameIndex.assign(nameIndex.size() * 2, -1);
+  size_t mask = nameIndex.size() - 1;
+  for (size_t i = 0; i < symbols.size(); i++) {
+    size_t slot = hashName(symbols[i].name) & mask;
+    while (nameIndex[slot] != -1) slot = (slot + 1) & mask;
+    nameIndex[slot] = i;
+  }
 }
 
-Symbol* SymbolTable::getSymbolByNumber(int num) {
-  for (auto const& x: table) {
-    if (x.second->number == num) return (x.second);
+Symbol* SymbolTable::insertSymbol(std::string_view n, int val, bool isGl, bool isExt, int s, int secNum, int num, std::string_view f) {
+  if ((symbols.size() + 1) * 2 > nameIndex.size()) growNameIndex();
+  size_t mask = nameIndex.size() - 1;
+  size_t slot = hashName(n) & mask;
+  while (nameIndex[slot] != -1) {
+    if (symbols[nameIndex[slot]].name == n) return nullptr;
+    slot = (slot + 1) & mask;
   }
-  return nullptr;
+  nameIndex[slot] = symbols.size();
+  if (num >= (int)numberIndex.size()) numberIndex.resize(num + 1, -1);
+  numberIndex[num] = symbols.size();
+
+  Symbol symbol;
+  symbol.name = names.intern(n);
+  symbol.value = val;
+  symbol.isGlobal = isGl;
+  symbol.isExtern = isExt;
+  symbol.number = num;
+  symbol.size = s;
+  symbol.sectionNumber = secNum;
+  if (!f.empty()) {
+    if (f != lastOrigin) lastOrigin = names.intern(f);
+    symbol.originFile = lastOrigin;
+  }
+  symbols.push_back(std::move(symbol));
+  return &symbols.back();
+}
+
+Symbol* SymbolTable::addSymbol(std::string_view n, int val, bool isGl, bool isExt, int s, bool isDef, std::string_view f) {
+  int number = nextNumber++;
+  int sectionNumber = 0;
+  if (isDef) {
+    if (s != -1) currentSectionNumber = number; //if symbol is a section
+    sectionNumber = currentSectionNumber;
+  }
+  return insertSymbol(n, val, isGl, isExt, s, sectionNumber, number, f);
 }
 
-bool SymbolTable::updateSectionSize(std::string key, int size) {
-  std::map<std::string, Symbol*>::iterator it = table.find(key);
-  if (it != table.end()) {
-    Symbol* symbol = it->second;
-    symbol->size = size;
-    return true;
-  } else return false;
+Symbol* SymbolTable::addSymbol(std::string_view n, int val, bool isGl, bool isExt, int s, bool isDef, SymbolUsage usage) {
+  Symbol* symbol = addSymbol(n, val, isGl, isExt, s, isDef);
+  if (symbol != nullptr) symbol->backpatch.push_back(usage);
+  return symbol;
 }
 
-void SymbolTable::addSymbolUsage(std::string key, SymbolUsage usage) {
-  std::map<std::string, Symbol*>::iterator it = table.find(key);
-  if (it != table.end()) {
-    Symbol* symbol = it->second;
-    symbol->backpatch.push_back(usage);
+Symbol* SymbolTable::getSymbolByKey(std::string_view key) {
+  size_t mask = nameIndex.size() - 1;
+  for (size_t slot = hashName(key) & mask; nameIndex[slot] != -1; slot = (slot + 1) & mask) {
+    if (symbols[nameIndex[slot]].name == key) return &symbols[nameIndex[slot]];
   }
+  return nullptr;
+}
+
+Symbol* SymbolTable::getSymbolByNumber(int num) {
+  if (num < 0 || num >= (int)numberIndex.size() || numberIndex[num] == -1) return nullptr;
+  return &symbols[numberIndex[num]];
+}
+
+bool SymbolTable::updateSectionSize(std::string_view key, int size) {
+  Symbol* symbol = getSymbolByKey(key);
+  if (symbol == nullptr) return false;
+  symbol->size = size;
+  return true;
+}
+
+void SymbolTable::addSymbolUsage(std::string_view key, SymbolUsage usage) {
+  Symbol* symbol = getSymbolByKey(key);
+  if (symbol != nullptr) symbol->backpatch.push_back(usage);
 }
 
-void SymbolTable::defineAndUpdateSymbol(std::string key, int lc) {
-  std::map<std::string, Symbol*>::iterator it = table.find(key);
-  if (it != table.end()) {
-    Symbol* symbol = it->second;
+void SymbolTable::defineAndUpdateSymbol(std::string_view key, int lc) {
+  Symbol* symbol = getSymbolByKey(key);
+  if (symbol != nullptr) {
     symbol->value = lc;
-    symbol->sectionNumber = Symbol::currentSectionNumber; 
+    symbol->sectionNumber = currentSectionNumber;
   }
 }
 
+std::vector<Symbol*> SymbolTable::sortedByName() {
+  std::vector<Symbol*> sorted;
+  sorted.reserve(symbols.size());
+  for (Symbol& symbol: symbols) sorted.push_back(&symbol);
+  std::sort(sorted.begin(), sorted.end(), [](const Symbol* a, const Symbol* b) { return a->name < b->name; });
+  return sorted;
+}
+
 inline std::string boolToString(bool b) {return b ? "true" : "false";}
 
-std::ostream& operator<<(std::ostream& os, const SymbolTable& tabela) {
-  Symbol* sym;
-  for(auto x: tabela.table) {
-    sym = x.second;
+std::ostream& operator<<(std::ostream& os, SymbolTable& tabela) {
+  for(Symbol* sym: tabela.sortedByName()) {
     os << sym->name << ':' << sym->sectionNumber << ':' << sym->value << ':' << boolToString(sym->isGlobal) << ':'
      << boolToString(sym->isExtern) << ':' << sym->number << ':' << sym->size << ":\n";
   }
@@ -61,27 +145,16 @@ std::ostream& operator<<(std::ostream& os, const SymbolTable& tabela) {
   return os;
 }
 
-bool SymbolTable::isSection(std::string key) {
+bool SymbolTable::isSection(std::string_view key) {
   Symbol* symbol = getSymbolByKey(key);
   if (symbol == nullptr) return false;
   return symbol->size != -1;
 }
 
-void SymbolTable::removeSymbol(std::string key) {
-  std::map<std::string, Symbol*>::iterator itr = table.find(key);
-  if (itr != table.end()) {
-    delete (itr->second);
-    table.erase(itr);
-  }
-}
-
 void SymbolTable::emptyTable() {
-  for(std::map<std::string, Symbol*>::iterator itr = table.begin(); itr != table.end(); itr++){
-    delete (itr->second);
-  }
-  table.clear();
+  symbols.clear();
+  nameIndex.assign(64, -1);
+  numberIndex.clear();
+  names.clear();
+  lastOrigin = std::string_view();
 }
-
-SymbolTable::~SymbolTable(){
-  emptyTable();
-}
\ No newline at end of file
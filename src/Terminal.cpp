@@ -0,0 +1,72 @@
+#include "../inc/Terminal.hpp"
+#include <chrono>
+#include <cstdio>
+#include <poll.h>
+#include <unistd.h>
+
+Terminal::Terminal(FlushPolicy p, int intervalMicroseconds) : head(0), tail(0), running(false), flushDue(false), out(stdout), capture(nullptr), interactive(true), policy(p), interval(intervalMicroseconds) {}
+
+Terminal::~Terminal() {
+  stop();
+  flush();
+}
+
+void Terminal::configure(FlushPolicy p, int intervalMicroseconds) {
+  policy = p;
+  interval = intervalMicroseconds > 0 ? intervalMicroseconds : 1;
+}
+
+void Terminal::start() {
+  if (running || !interactive) return;
+  running = true;
+  reader = std::thread(&Terminal::readInput, this);
+}
+
+void Terminal::stop() {
+  if (!running) return;
+  running = false;
+  reader.join();
+}
+
+void Terminal::flush() {
+  if (output.empty()) return;
+  if (capture != nullptr) {
+    *capture += output;
+    output.clear();
+    return;
+  }
+  fwrite(output.data(), 1, output.size(), out);
+  fflush(out);
+  output.clear();
+}
+
+// runs on the reader thread, also keeps time for the interval flush policy
+void Terminal::readInput() {
+  using namespace std::chrono;
+  bool endOfInput = false;
+  int timeout = policy == FLUSH_EVERY_INTERVAL ? (interval + 999) / 1000 : 10; // milliseconds
+  steady_clock::time_point lastFlush = steady_clock::now();
+
+  while (running) {
+    if (endOfInput) usleep(timeout * 1000);
+    else {
+      pollfd descriptor = {STDIN_FILENO, POLLIN, 0};
+      if (::poll(&descriptor, 1, timeout) > 0) {
+        unsigned char buffer[256];
+        ssize_t count = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (count <= 0) endOfInput = true;
+        for (ssize_t i = 0; i < count && running; i++) {
+          if (buffer[i] == 0) continue; // zero means no input to the guest
+          unsigned h = head.load(std::memory_order_relaxed);
+          while (h - tail.load(std::memory_order_acquire) == RING_SIZE && running) usleep(100);
+          ring[h & (RING_SIZE - 1)] = buffer[i];
+          head.store(h + 1, std::memory_order_release);
+        }
+      }
+    }
+    if (policy == FLUSH_EVERY_INTERVAL && steady_clock::now() - lastFlush >= microseconds(interval)) {
+      flushDue.store(true, std::memory_order_relaxed);
+      lastFlush = steady_clock::now();
+    }
+  }
+}